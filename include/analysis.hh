@@ -1,14 +1,37 @@
 #pragma once
 
 #include "TFile.h"
+#include "calibration.hh"
+#include "clustering.hh"
 #include "data.hh"
+#include "event_cache.hh"
+#include "event_kernel.hh"
 #include "graphs.hh"
 #include "pixel_collection.hh"
+#include "pixel_map.hh"
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace analysis
 {
+/**
+ * Structure containing the reader and
+ * the accumulators of a thread of the
+ * parallel event loop.
+ */
+struct Worker {
+    std::unique_ptr<TFile> file; // not opened when reading from the event cache
+    TTree *event_tree = nullptr;
+    std::unique_ptr<data::Event> event;
+    std::unique_ptr<graphs::Histograms> hist;
+    std::vector<pixel::PixelCollection> pixel_collections;
+    std::unique_ptr<pixel::PixelMap> pixel_map;                // only with --pixel-map
+    std::unique_ptr<clustering::ClusterFinder> cluster_finder; // only with --clusters
+};
+
 /**
  * Class for running the analysis
  * of the results obtained from the
@@ -21,18 +44,42 @@ class Analysis
     std::unique_ptr<data::Event> event;
     std::unique_ptr<graphs::Histograms> hist;
 
+    std::string results_path;
     std::unique_ptr<TFile> results_file;
     TTree *info_tree, *event_tree;
+    data::IOProfile io_profile;
+    data::EventCuts cuts;
+    std::shared_ptr<const data::EventCache> event_cache;
+
+    // the binning of the options, followed by the ones of the sweep (if any)
+    std::vector<pixel::Binning> binnings;
+    std::vector<pixel::PixelCollection> pixel_collections;
+    std::unique_ptr<pixel::PixelMap> pixel_map;                // spectra of all the pixels (only with --pixel-map)
+    std::unique_ptr<clustering::ClusterFinder> cluster_finder; // clusters of each event (only with --clusters)
+    std::unique_ptr<kernel::EventKernel> event_kernel;
 
-    std::unique_ptr<pixel::PixelCollection> pixel_collection;
+    // transition probabilities computed in this run (calibration mode)
+    std::shared_ptr<const solve_system::TransitionProbabilities> calibration_probabilities;
+    // system of the probabilities used, built once for the pixel 0 and the pixel map
+    std::unique_ptr<const solve_system::Solver> solver;
+    Long64_t first_entry = 0;
 
-    void show_results() const;
+    std::uint64_t calibration_key() const;
+    void calibrate();
+    void show_results();
+    void save_sweep() const;
+    void save_pixel_map();
+    void run_interactive();
+    void run_batch();
+    Worker make_worker() const;
+    std::vector<pixel::PixelCollection> make_pixel_collections() const;
+    std::unique_ptr<clustering::ClusterFinder> make_cluster_finder() const;
 
   public:
     Analysis();
     ~Analysis();
 
     void get_trees();
-    void run() const;
+    void run();
 };
 } // namespace analysis
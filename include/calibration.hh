@@ -0,0 +1,79 @@
+#pragma once
+
+#include "data.hh"
+#include "pixel_collection.hh"
+#include "solve_system.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace calibration
+{
+// directory of the calibrations
+constexpr const char STORE_DIRECTORY[] = "../calibrations/";
+
+/**
+ * Header of a calibration file.
+ *
+ * The geometry, the beam width, the binning and the
+ * dataset identify the calibration, the number of events is used to choose
+ * between calibrations of the same setup.
+ */
+struct CalibrationHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::int32_t n_pixel;
+    std::int32_t n_subpixel;
+    std::int32_t beam_type;
+    std::int32_t n_thresholds;
+    std::int32_t beam_width;
+    std::int32_t reserved; // 0, keeps the doubles aligned
+    double pixel_dimensions[2];
+    double subpixel_dimensions[2];
+    double min_threshold;
+    double max_threshold;
+    std::uint64_t source; // key of the dataset (see `source_key()`)
+    std::int64_t n_events;
+    std::uint64_t n_cells; // nonzero transition probabilities
+};
+
+/**
+ * Class for reading a calibration file,
+ * i.e. the header followed by the nonzero
+ * transition probabilities (cells (i, j, probability)
+ * in row-major order), mapped into memory.
+ */
+class Calibration
+{
+  private:
+    void *mapping = nullptr;
+    std::size_t mapping_size = 0;
+
+    const CalibrationHeader *header = nullptr;
+    const solve_system::TransitionProbabilities::Cell *cells = nullptr;
+
+  public:
+    Calibration(const std::string &path);
+    ~Calibration();
+
+    Calibration(const Calibration &) = delete;
+    Calibration &operator=(const Calibration &) = delete;
+
+    // Returns the header.
+    const CalibrationHeader &get_header() const { return *header; }
+    bool matches(const data::Geometry &geometry, const pixel::Binning &binning, int beam_width) const;
+    solve_system::TransitionProbabilities get_probabilities() const;
+};
+
+std::shared_ptr<const solve_system::TransitionProbabilities> find(const std::string &directory,
+                                                                  const data::Geometry &geometry,
+                                                                  const pixel::Binning &binning, int beam_width,
+                                                                  std::uint64_t source = 0);
+void save(const std::string &directory, const data::Geometry &geometry, const pixel::Binning &binning,
+          int beam_width, std::uint64_t source, std::int64_t n_events,
+          const solve_system::TransitionProbabilities &probabilities);
+std::uint64_t source_key(const std::string &path, std::int64_t n_entries);
+bool same_geometry(const data::Geometry &a, const data::Geometry &b);
+} // namespace calibration
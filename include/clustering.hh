@@ -0,0 +1,60 @@
+#pragma once
+
+#include "TDataType.h"
+#include "data.hh"
+
+#include <memory>
+#include <vector>
+
+namespace clustering
+{
+/**
+ * Structure containing a cluster
+ * of adjacent pixels hit in an event.
+ */
+struct Cluster {
+    double energy; // summed over the pixels
+    double x;      // energy-weighted centroid
+    double y;
+    int size; // # of pixels
+};
+
+/**
+ * Class for finding all the clusters
+ * of adjacent pixels hit in an event.
+ *
+ * The hits above the threshold are placed on a grid with one
+ * cell per pixel, and the ones next to each other (sharing a
+ * side, or also a corner with 8-connectivity) are joined with
+ * a union-find over the hits. The grid and the buffers are
+ * reused from one event to the next, so an event costs about
+ * O(hits) with no allocations once they are large enough.
+ * Each thread of the event loop needs its own instance.
+ */
+class ClusterFinder
+{
+  private:
+    std::shared_ptr<const data::PSFInfo> psf_info;
+    int connectivity;
+    double threshold;
+
+    std::vector<int> grid;    // index of the hit in each pixel (-1 if not hit)
+    std::vector<int> parent;  // union-find forest over the hits
+    std::vector<int> cluster; // index of the cluster of each root hit
+    std::vector<Cluster> clusters;
+
+    static bool verbose;
+
+    int find_root(int i);
+    void unite(int i, int j);
+
+  public:
+    ClusterFinder(std::shared_ptr<const data::PSFInfo> psf, int connectivity, double threshold);
+    ~ClusterFinder() = default;
+
+    const std::vector<Cluster> &find(data::Span<Int_t> ids, data::Span<Double_t> energies);
+
+    // Set verbosity of the class.
+    static void set_verbose(bool value) { verbose = value; }
+};
+} // namespace clustering
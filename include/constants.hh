@@ -14,5 +14,15 @@ inline void print_info(const char *message) { printf("%s%s%s\n", INFO_COLOR, mes
 inline void print_warning(const char *message) { printf("%s%s%s\n", WARNING_COLOR, message, END_COLOR); }
 inline void print_error(const char *message) { printf("%s%s%s\n", ERROR_COLOR, message, END_COLOR); }
 
-// # of pixels considered (including 0)
-constexpr int MAX_PSF_ELEMENTS = 2;
+// # of types of pixels considered (0, T and TR)
+constexpr int MAX_PSF_ELEMENTS = 3;
+// # of pixels of each type around 0
+constexpr int PSF_NEIGHBOURS = 4;
+// # of pixels considered (0, the four T and the four TR)
+constexpr int PSF_PIXELS = 1 + (MAX_PSF_ELEMENTS - 1) * PSF_NEIGHBOURS;
+
+// pairs (T, TR) of adjacent pixels around 0, as indices in `PSFInfo::id_pixel_t` and `PSFInfo::id_pixel_tr`
+constexpr int CORNER_PAIRS[8][2] = {{0, 0}, {0, 1}, {1, 0}, {1, 2}, {2, 1}, {2, 3}, {3, 2}, {3, 3}};
+
+// # of entries per block of the parallel event loop
+constexpr long long EVENT_BLOCK_SIZE = 50'000;
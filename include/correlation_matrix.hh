@@ -0,0 +1,144 @@
+#pragma once
+
+#include "counter_array.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace pixel
+{
+// largest # of bins stored as a dense matrix (4 MB of 32-bit counts)
+constexpr int DENSE_MAX_BINS = 1024;
+
+/**
+ * Class for storing the counts of the coincidences
+ * between the energy bins of two pixels.
+ *
+ * Up to `DENSE_MAX_BINS` bins the counts are stored in
+ * one contiguous row-major buffer of 32-bit cells, which
+ * spill to 64-bit counters on saturation; above, only the
+ * bins that were hit are stored, in a hash table.
+ */
+class CorrelationMatrix
+{
+  private:
+    int n_bins = 0;
+    bool dense = true;
+    CounterArray<std::uint32_t> counts;                             // dense storage
+    std::unordered_map<std::uint64_t, std::uint64_t> sparse_counts; // sparse storage, key i * n_bins + j
+
+    std::uint64_t key(int i, int j) const { return static_cast<std::uint64_t>(i) * n_bins + j; }
+
+  public:
+    CorrelationMatrix() = default;
+    CorrelationMatrix(int n_bins);
+
+    // Returns the number of bins per side.
+    int size() const { return n_bins; }
+    // Returns whether the counts are stored as a dense matrix.
+    bool is_dense() const { return dense; }
+
+    // Returns the counts in the bin (i, j).
+    std::uint64_t operator()(int i, int j) const
+    {
+        if (dense) return counts[key(i, j)];
+
+        auto it = sparse_counts.find(key(i, j));
+        return (it != sparse_counts.end()) ? it->second : 0;
+    }
+
+    // Adds a count to the bin (i, j).
+    void increment(int i, int j)
+    {
+        if (dense) counts.increment(key(i, j));
+        else sparse_counts[key(i, j)]++;
+    }
+
+    void add(const CorrelationMatrix &other);
+    void reset();
+
+    /**
+     * Function for visiting the bins with counts,
+     * in row-major order.
+     *
+     * @param[in] f The function called as f(i, j, counts).
+     */
+    template <class F> void for_each_nonzero(F f) const
+    {
+        if (dense) {
+            for (int i = 0; i < n_bins; i++) {
+                for (int j = 0; j < n_bins; j++)
+                    if (std::uint64_t c = counts[key(i, j)]) f(i, j, c);
+            }
+            return;
+        }
+
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> entries(sparse_counts.begin(), sparse_counts.end());
+        std::sort(entries.begin(), entries.end());
+        for (const auto &[k, c] : entries)
+            if (c) f(static_cast<int>(k / n_bins), static_cast<int>(k % n_bins), c);
+    }
+};
+
+/**
+ * Class for storing the counts of the coincidences
+ * between the energy bins of three pixels.
+ *
+ * A dense N^3 tensor is too large for fine binnings, while
+ * few bins are hit, so only those are stored, in a hash table.
+ */
+class CoincidenceTensor
+{
+  private:
+    int n_bins = 0;
+    std::unordered_map<std::uint64_t, std::uint64_t> counts; // key (i * n_bins + j) * n_bins + k
+
+    std::uint64_t key(int i, int j, int k) const
+    {
+        return (static_cast<std::uint64_t>(i) * n_bins + j) * n_bins + k;
+    }
+
+  public:
+    CoincidenceTensor() = default;
+    CoincidenceTensor(int n_bins);
+
+    // Returns the number of bins per side.
+    int size() const { return n_bins; }
+    // Returns the number of bins with counts.
+    std::size_t get_n_entries() const { return counts.size(); }
+
+    // Returns the counts in the bin (i, j, k).
+    std::uint64_t operator()(int i, int j, int k) const
+    {
+        auto it = counts.find(key(i, j, k));
+        return (it != counts.end()) ? it->second : 0;
+    }
+
+    // Adds a count to the bin (i, j, k).
+    void increment(int i, int j, int k) { counts[key(i, j, k)]++; }
+
+    void add(const CoincidenceTensor &other);
+    void reset();
+
+    /**
+     * Function for visiting the bins with counts,
+     * in row-major order.
+     *
+     * @param[in] f The function called as f(i, j, k, counts).
+     */
+    template <class F> void for_each_nonzero(F f) const
+    {
+        std::vector<std::pair<std::uint64_t, std::uint64_t>> entries(counts.begin(), counts.end());
+        std::sort(entries.begin(), entries.end());
+        for (const auto &[key, c] : entries) {
+            int k = key % n_bins;
+            int j = (key / n_bins) % n_bins;
+            int i = key / n_bins / n_bins;
+            f(i, j, k, c);
+        }
+    }
+};
+} // namespace pixel
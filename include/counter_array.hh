@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+namespace pixel
+{
+/**
+ * Class for storing an array of counts in
+ * cells of type `Cell` (8, 16 or 32 bits).
+ *
+ * A cell saturates at its largest value, and the counts
+ * above it are kept in a 64-bit overflow table, so the
+ * counts are exact at any scale while the array of
+ * cells keeps the cache footprint of the narrow type.
+ */
+template <class Cell> class CounterArray
+{
+    static_assert(std::is_unsigned_v<Cell> && sizeof(Cell) <= 4, "the cells are unsigned 8, 16 or 32-bit integers");
+
+  private:
+    static constexpr Cell MAX_CELL = std::numeric_limits<Cell>::max();
+
+    std::vector<Cell> cells;
+    std::unordered_map<std::size_t, std::uint64_t> overflow; // counts above MAX_CELL
+
+  public:
+    CounterArray() = default;
+    explicit CounterArray(std::size_t size)
+        : cells(size, 0)
+    {
+    }
+
+    // Returns the number of counters.
+    std::size_t size() const { return cells.size(); }
+    // Returns the number of counters that spilled to the overflow table.
+    std::size_t get_n_overflows() const { return overflow.size(); }
+
+    // Returns the counts of the counter i.
+    std::uint64_t operator[](std::size_t i) const
+    {
+        if (cells[i] != MAX_CELL) return cells[i];
+
+        auto it = overflow.find(i);
+        return MAX_CELL + ((it != overflow.end()) ? it->second : 0);
+    }
+
+    // Adds a count to the counter i.
+    void increment(std::size_t i)
+    {
+        if (cells[i] != MAX_CELL) cells[i]++;
+        else overflow[i]++;
+    }
+
+    // Adds n counts to the counter i.
+    void add(std::size_t i, std::uint64_t n)
+    {
+        std::uint64_t room = MAX_CELL - cells[i];
+        if (n <= room) {
+            cells[i] += n;
+            return;
+        }
+
+        cells[i] = MAX_CELL;
+        overflow[i] += n - room;
+    }
+
+    /**
+     * Function for adding the counts
+     * of another array to this one.
+     *
+     * @param[in] other The array with the same size.
+     */
+    template <class OtherCell> void add(const CounterArray<OtherCell> &other)
+    {
+        for (std::size_t i = 0; i < cells.size(); i++)
+            if (other.cells[i]) add(i, other[i]);
+    }
+
+    // Sets all the counts to 0.
+    void reset()
+    {
+        std::fill(cells.begin(), cells.end(), 0);
+        overflow.clear();
+    }
+
+    /**
+     * Function for copying the counts
+     * of the counters [first, last).
+     *
+     * @param[in] first The first counter.
+     * @param[in] last The counter after the last one.
+     * @param[out] out The buffer with room for last - first values.
+     */
+    template <class T> void copy(std::size_t first, std::size_t last, T *out) const
+    {
+        for (std::size_t i = first; i < last; i++)
+            out[i - first] = static_cast<T>((*this)[i]);
+    }
+
+    // Returns the counts as doubles.
+    std::vector<double> to_vector() const
+    {
+        std::vector<double> counts(cells.size());
+        copy(0, cells.size(), counts.data());
+        return counts;
+    }
+
+    template <class OtherCell> friend class CounterArray;
+};
+} // namespace pixel
@@ -1,22 +1,66 @@
 #pragma once
 
 #include "TTree.h"
+#include "constants.hh"
 
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <vector>
 
 namespace data
 {
+// Role of a pixel with respect to the PSF (the roles after TR are the outer classes of a larger PSF).
+enum PixelRole : std::uint8_t { ROLE_0, ROLE_T, ROLE_TR, ROLE_OUTSIDE = 255 };
+
+/**
+ * Structure containing the role of a
+ * pixel and its coordinates in the array.
+ */
+struct PixelInfo {
+    std::uint8_t role;     // the PixelRole
+    std::uint8_t index;    // the index among the T or TR pixels
+    std::uint8_t interior; // whether all the T and TR pixels around it are in the array
+    std::uint16_t x;
+    std::uint16_t y;
+};
+
 /**
  * Structure containing the info
  * about the pixels used for reconstructing
  * the spectrum.
  */
 struct PSFInfo {
+    int n_pixel;
+    int radius; // the PSF is (2 * radius + 1) x (2 * radius + 1) pixels
     int id_pixel_0;
     std::array<int, 4> id_pixel_t;
     std::array<int, 4> id_pixel_tr;
 
-    void get_ids(int n_pixel);
+    std::vector<PixelInfo> pixels; // role and coordinates of each pixel of the array
+    // IDs of the T and then of the TR pixels around each pixel (-1 outside the array)
+    std::vector<std::array<int, PSF_PIXELS - 1>> neighbours;
+
+    void get_ids(int n_pixel, int radius = 1);
+    template <int RADIUS> void assign_roles();
+
+    // Returns the role and the coordinates of the pixel.
+    const PixelInfo &get_pixel(int id) const { return pixels[id]; }
+    // Returns the # of roles in the PSF (0, T, TR and the outer classes).
+    int get_n_roles() const { return (radius + 1) * (radius + 2) / 2; }
+};
+
+/**
+ * Structure containing the geometry of the
+ * detector, which a calibration must match.
+ */
+struct Geometry {
+    Int_t n_pixel;
+    Double_t pixel_dimensions[2];
+    Int_t n_subpixel;
+    Double_t subpixel_dimensions[2];
+    Int_t beam_type;
 };
 
 /**
@@ -48,6 +92,12 @@ class Info
     int get_beam_width() const { return beam_width; }
     // Returns the type of spectrum.
     int get_beam_type() const { return beam_type; }
+    // Returns the geometry of the detector.
+    Geometry get_geometry() const
+    {
+        return {n_pixel, {pixel_dimensions[0], pixel_dimensions[1]}, n_subpixel,
+                {subpixel_dimensions[0], subpixel_dimensions[1]}, beam_type};
+    }
     // Returns the psf info structure.
     std::shared_ptr<PSFInfo> get_psf_info() { return std::make_shared<PSFInfo>(psf_info); }
 
@@ -56,40 +106,142 @@ class Info
 };
 
 /**
- * Struct containing single entries
- * of the Event TTree.
+ * Non-owning view over a contiguous
+ * array of elements (`std::span` is C++20).
  */
-struct Entry {
+template <class T> class Span
+{
+  private:
+    const T *first = nullptr;
+    std::size_t count = 0;
+
+  public:
+    Span() = default;
+    Span(const T *data, std::size_t size)
+        : first(data)
+        , count(size)
+    {
+    }
+    Span(const std::vector<T> &v)
+        : first(v.data())
+        , count(v.size())
+    {
+    }
+
+    const T *data() const { return first; }
+    std::size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T *begin() const { return first; }
+    const T *end() const { return first + count; }
+    const T &operator[](std::size_t i) const { return first[i]; }
+};
+
+/**
+ * Struct containing a non-owning view
+ * of the current entry of the Event TTree.
+ *
+ * The spans point to the branch buffers, so they
+ * are valid until the next entry is read (or to
+ * the event cache, valid as long as the cache).
+ */
+struct EventView {
     Int_t event_id;
     Double_t photon_energy;
-    std::vector<Int_t> id_pixel;
-    std::vector<Double_t> pixel_energy;
-    std::vector<Int_t> id_pixel_cs;
-    std::vector<Double_t> pixel_energy_cs;
+    Span<Int_t> id_pixel;
+    Span<Double_t> pixel_energy;
+    Span<Int_t> id_pixel_cs;
+    Span<Double_t> pixel_energy_cs;
+};
+
+/**
+ * Structure describing which branches of the
+ * Event TTree are needed by the enabled stages.
+ *
+ * The charge sharing hits (ID_Merge, Energy_Merge)
+ * are always read, since the reconstruction needs them.
+ */
+struct IOProfile {
+    bool event_id = true;          // Event_ID, only used when printing the entries
+    bool photon_energy = true;     // Photon_energy
+    bool no_charge_sharing = true; // ID_Merge_NOCS, Energy_Merge_NOCS
+
+    static IOProfile from_options();
+};
+
+/**
+ * Structure containing the cuts applied
+ * to the events before processing them.
+ *
+ * The cuts use only the photon energy and the IDs of
+ * the charge sharing hits, so they are evaluated before
+ * the other branches of the entry are read.
+ */
+struct EventCuts {
+    double min_photon_energy = 0; // no cut if max <= min
+    double max_photon_energy = 0;
+    int min_hits = 0;
+    int max_hits = -1;    // no cut if negative
+    bool psf_hit = false; // at least a hit in the PSF
+
+    // Returns whether the photon energy is cut.
+    bool on_photon_energy() const { return max_photon_energy > min_photon_energy; }
+    // Returns whether the hits are cut.
+    bool on_hits() const { return min_hits > 0 || max_hits >= 0 || psf_hit; }
+    // Returns whether any cut is applied.
+    bool enabled() const { return on_photon_energy() || on_hits(); }
+
+    // Returns whether the photon energy passes the cut.
+    bool pass_photon_energy(Double_t energy) const
+    {
+        return energy >= min_photon_energy && energy < max_photon_energy;
+    }
+    bool pass_hits(Span<Int_t> ids, const PSFInfo &psf) const;
+
+    static EventCuts from_options();
 };
 
+class EventCache;
+
 /**
  * Class for reading and storing the
  * results of the Geant4 simulation.
+ *
+ * The events are read either from the TTree
+ * or from the memory-mapped event cache.
  */
 class Event
 {
   private:
     static bool verbose;
 
-    Int_t event_id;
-    Double_t photon_energy;
+    TTree *tree = nullptr;
+    std::shared_ptr<const EventCache> cache;
+
+    // branches read by `select()` before the others
+    TBranch *photon_energy_branch = nullptr;
+    TBranch *id_pixel_cs_branch = nullptr;
+    std::vector<TBranch *> other_branches;
+    Long64_t selected_entry = -1;
+    Long64_t selected_local_entry = -1; // entry in the current tree, returned by LoadTree
+    bool photon_energy_read = false;
+    bool id_pixel_cs_read = false;
+
+    Int_t event_id{};
+    Double_t photon_energy{};
     std::vector<Int_t> *id_pixel = nullptr;
     std::vector<Double_t> *pixel_energy = nullptr;
     std::vector<Int_t> *id_pixel_cs = nullptr;
     std::vector<Double_t> *pixel_energy_cs = nullptr;
 
   public:
-    Event(TTree *hits_tree);
+    Event(TTree *hits_tree, const IOProfile &profile);
+    Event(std::shared_ptr<const EventCache> event_cache);
     ~Event();
 
-    Entry get_entry() const;
-    void clearEntry(Entry &entry) const;
+    Long64_t get_entries() const;
+    void set_entry_range(Long64_t first, Long64_t last);
+    bool select(Long64_t entry, const EventCuts &cuts, const PSFInfo &psf);
+    EventView read(Long64_t entry);
 
     // Set verbosity of the class.
     static void set_verbose(bool value) { verbose = value; }
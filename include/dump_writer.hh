@@ -0,0 +1,53 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace graphs
+{
+// # of values per block handed to the writer thread
+constexpr std::size_t DUMP_BLOCK_SIZE = 1 << 20;
+
+/**
+ * Class for writing a column of energies
+ * to a binary file from a separate thread.
+ *
+ * The file starts with a 16-byte header (the magic
+ * "EDMP", the version and the number of values),
+ * followed by the values as 32-bit floats.
+ */
+class DumpWriter
+{
+  private:
+    std::ofstream file;
+    std::uint64_t n_values = 0;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::vector<float>> queue;
+    std::vector<std::vector<float>> free_blocks;
+    bool done = false;
+    bool failed = false; // a write failed, the next blocks are dropped
+
+    void write_loop();
+
+  public:
+    DumpWriter(const std::string &path);
+    ~DumpWriter();
+
+    DumpWriter(const DumpWriter &) = delete;
+    DumpWriter &operator=(const DumpWriter &) = delete;
+
+    void submit(std::vector<float> &block);
+    bool close();
+
+    static void export_text(const std::string &binary_path, const std::string &text_path);
+};
+} // namespace graphs
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "TTree.h"
+#include "data.hh"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace data
+{
+// directory of the event caches (not ../results/, where the ROOT files are picked)
+constexpr const char CACHE_DIRECTORY[] = "../cache/";
+
+/**
+ * Header of the event cache file.
+ *
+ * The size and the modification time of the ROOT
+ * file are stored to detect a stale cache.
+ */
+struct EventCacheHeader {
+    char magic[4];
+    std::uint32_t version;
+    std::uint64_t n_events;
+    std::uint64_t n_hits;    // hits without charge sharing
+    std::uint64_t n_hits_cs; // hits with charge sharing
+    std::int64_t source_size;
+    std::int64_t source_time;
+};
+
+/**
+ * Class for reading the Event TTree from a
+ * memory-mapped file in CSR layout.
+ *
+ * After the header, the file contains the columns
+ * photon_energy[n_events], offsets[n_events + 1],
+ * offsets_cs[n_events + 1], pixel_energy[n_hits],
+ * pixel_energy_cs[n_hits_cs], event_id[n_events],
+ * id_pixel[n_hits] and id_pixel_cs[n_hits_cs], so the
+ * hits of the i-th event are in [offsets[i], offsets[i + 1]).
+ */
+class EventCache
+{
+  private:
+    void *mapping = nullptr;
+    std::size_t mapping_size = 0;
+
+    const EventCacheHeader *header = nullptr;
+    const Double_t *photon_energy = nullptr;
+    const std::uint64_t *offsets = nullptr;
+    const std::uint64_t *offsets_cs = nullptr;
+    const Double_t *pixel_energy = nullptr;
+    const Double_t *pixel_energy_cs = nullptr;
+    const Int_t *event_id = nullptr;
+    const Int_t *id_pixel = nullptr;
+    const Int_t *id_pixel_cs = nullptr;
+
+  public:
+    EventCache(const std::string &path);
+    ~EventCache();
+
+    EventCache(const EventCache &) = delete;
+    EventCache &operator=(const EventCache &) = delete;
+
+    // Returns the number of events.
+    Long64_t get_entries() const { return header->n_events; }
+    EventView get_view(Long64_t entry) const;
+
+    static bool is_valid(const std::string &path, const std::string &source_path);
+    static void build(TTree *hits_tree, const std::string &path, const std::string &source_path);
+};
+} // namespace data
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "clustering.hh"
+#include "data.hh"
+#include "graphs.hh"
+#include "pixel_collection.hh"
+#include "pixel_map.hh"
+
+#include <memory>
+#include <vector>
+
+namespace kernel
+{
+/**
+ * Class for processing the events.
+ *
+ * Each event is processed with one pass over the
+ * hits with and without charge sharing, which fills
+ * the total energy, the energy per pixel, the PSF
+ * histograms and the sums of the reference algorithm,
+ * classifying the hits through the table with the role
+ * of each pixel. The other accumulators take the whole
+ * arrays of the event: the spectra are filled with one
+ * vectorized loop, each pixel collection bins the energies
+ * with its own binning, the pixel map reuses the bins of
+ * the first collection and the cluster finder walks the
+ * hits on its own grid. The stages whose branches are
+ * not in the I/O profile are skipped.
+ */
+class EventKernel
+{
+  private:
+    int n_pixel;
+    std::shared_ptr<data::PSFInfo> psf_info;
+    data::IOProfile profile;
+
+    static bool verbose;
+
+  public:
+    EventKernel(int n_pixel, std::shared_ptr<data::PSFInfo> psf, const data::IOProfile &profile);
+    ~EventKernel() = default;
+
+    void process(const data::EventView &event, graphs::Histograms &hist, std::vector<pixel::PixelCollection> &pixels,
+                 pixel::PixelMap *pixel_map = nullptr, clustering::ClusterFinder *cluster_finder = nullptr,
+                 bool print = false) const;
+
+    // Set verbosity of the class.
+    static void set_verbose(bool value) { verbose = value; }
+};
+} // namespace kernel
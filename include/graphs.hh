@@ -4,10 +4,17 @@
 #include "TH1D.h"
 #include "TH2D.h"
 #include "THStack.h"
+#include "clustering.hh"
 #include "data.hh"
+#include "dump_writer.hh"
+#include "histogram.hh"
+#include "pixel_collection.hh"
 
+#include <array>
 #include <fstream>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace graphs
 {
@@ -20,52 +27,110 @@ class Histograms
 {
   private:
     int n_pixel;
+    pixel::Binning binning; // of the spectra of the pixels 0, T and TR
 
-    TH1D *hist_energy_spectrum;
-    TH1D *hist_energy_spectrum_cs;
+    // ROOT histograms (only the master has them)
+    TH1D *hist_energy_spectrum{};
+    TH1D *hist_energy_spectrum_cs{};
 
-    TH1D *hist_total_energy;
-    TH1D *hist_total_energy_cs;
+    TH1D *hist_total_energy{};
+    TH1D *hist_total_energy_cs{};
 
-    TH2D *hist_energy_pixels;
-    TH2D *hist_energy_pixels_cs;
+    TH2D *hist_energy_pixels{};
+    TH2D *hist_energy_pixels_cs{};
 
-    TH1D *hist_energy_central;
-    TH1D *hist_energy_t;
-    TH1D *hist_energy_tr;
+    TH1D *hist_energy_central{};
+    TH1D *hist_energy_t{};
+    TH1D *hist_energy_tr{};
 
-    TH1D *hist_photon_energy;
-    TH1D *hist_energy_central_corrected;
-    TH1D *hist_energy_central_corrected_reference;
-    THStack *hist_stack_corrections;
-    THStack *hist_stack_corrections_reference;
+    TH1D *hist_photon_energy{};
+    TH1D *hist_energy_central_corrected{};
+    TH1D *hist_energy_central_corrected_reference{};
+    THStack *hist_stack_corrections{};
+    THStack *hist_stack_corrections_reference{};
 
-    TCanvas *canvas_energy;
-    TCanvas *canvas_energy_pixel;
-    TCanvas *canvas_cross_talk;
-    TCanvas *canvas_reconstruction;
+    TH1D *hist_cluster_energy{};
+    TH1D *hist_cluster_size{};
+    TH1D *hist_cluster_multiplicity{};
+    TH2D *hist_cluster_centroids{};
+
+    // histograms filled in the event loop, copied into the ROOT ones at the end
+    Hist1D energy_spectrum;
+    Hist1D energy_spectrum_cs;
+
+    Hist1D total_energy;
+    Hist1D total_energy_cs;
+
+    Hist2D energy_pixels;
+    Hist2D energy_pixels_cs;
+
+    Hist1D energy_central;
+    Hist1D energy_t;
+    Hist1D energy_tr;
+
+    Hist1D photon_energy;
+    Hist1D energy_central_corrected_reference;
+
+    Hist1D cluster_energy;
+    Hist1D cluster_size;
+    Hist1D cluster_multiplicity;
+    Hist2D cluster_centroids;
+
+    TCanvas *canvas_energy{};
+    TCanvas *canvas_energy_pixel{};
+    TCanvas *canvas_cross_talk{};
+    TCanvas *canvas_reconstruction{};
+    TCanvas *canvas_clusters{};
 
     std::shared_ptr<data::PSFInfo> psf_info;
 
-    std::fstream energy_spectrum_file;
-    std::fstream energy_spectrum_cs_file;
-    std::fstream counts_file;
+    // energies dumped during the event loop (only the master has the writers)
+    enum Dump { DUMP_SPECTRUM, DUMP_SPECTRUM_CS, DUMP_COUNTS, DUMP_PHOTON, N_DUMPS };
+    std::array<std::vector<float>, N_DUMPS> dumps;
+    std::array<std::string, N_DUMPS> dump_paths; // without extension
+    std::array<std::unique_ptr<DumpWriter>, N_DUMPS> dump_writers;
+
     std::fstream reconstruction_file;
-    std::fstream photon_energy_file;
 
     static bool verbose;
 
-    void fill_psf_histograms(int id, double energy);
+    Histograms(const Histograms &master);
+
+    void materialize();
+
+    /**
+     * Function for adding a value to a dump, which is
+     * handed to the writer thread once the block is full.
+     *
+     * @param[in] column The dump (see `Dump`).
+     * @param[in] value The value.
+     */
+    void dump(int column, double value)
+    {
+        dumps[column].push_back(value);
+        if (dumps[column].size() >= DUMP_BLOCK_SIZE && dump_writers[column])
+            dump_writers[column]->submit(dumps[column]);
+    }
 
   public:
-    Histograms(int n_pixel, std::shared_ptr<data::PSFInfo> psf);
+    Histograms(int n_pixel, std::shared_ptr<data::PSFInfo> psf, const pixel::Binning &binning);
     ~Histograms();
 
-    void fill_histograms(std::vector<Int_t> v_id, std::vector<Double_t> v_energy, bool CS, bool print = false);
-    void fill_results(std::vector<Int_t> v_counts);
-    void fill_reference(std::vector<Int_t> v_id, std::vector<Double_t> v_energy);
+    std::unique_ptr<Histograms> make_worker_copy() const;
+    void merge(Histograms &worker);
+    void reset();
+
+    void fill_spectrum(data::Span<Double_t> energies, bool CS);
+    void fill_hit(const data::PixelInfo &pixel, double energy, bool CS);
+    void fill_psf_histograms(int role, double energy);
+    void fill_total_energy(double energy, bool CS);
+    void fill_results(const std::vector<long long> &v_counts);
+    void fill_reference(double energy);
     void fill_photon_energy(Double_t energy);
+    void fill_clusters(const std::vector<clustering::Cluster> &clusters);
     void show_histograms();
+    void save_histograms(const std::string &path);
+    void close_dumps();
 
     // Set verbosity of the class.
     static void set_verbose(bool value) { verbose = value; }
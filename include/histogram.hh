@@ -0,0 +1,160 @@
+#pragma once
+
+#include "TH1.h"
+#include "TH2.h"
+#include "data.hh"
+
+#include <algorithm>
+#include <vector>
+
+namespace graphs
+{
+/**
+ * Structure describing a fixed binning.
+ */
+struct Axis {
+    int n_bins{};
+    double x_min{};
+    double scale{}; // n_bins / (x_max - x_min)
+
+    Axis() = default;
+    Axis(int n_bins, double x_min, double x_max)
+        : n_bins(n_bins)
+        , x_min(x_min)
+        , scale(n_bins / (x_max - x_min))
+    {
+    }
+
+    /**
+     * Function for getting the bin of a value,
+     * without branches.
+     *
+     * @param[in] x The value.
+     *
+     * @return The bin (0 for underflow, n_bins + 1 for overflow).
+     */
+    int find_bin(double x) const
+    {
+        double t = std::max(-1.0, (x - x_min) * scale);
+        t = std::min(static_cast<double>(n_bins), t);
+        return static_cast<int>(t + 1.0);
+    }
+
+    // Returns whether the bin is not the underflow or the overflow.
+    bool in_range(int bin) const { return (bin >= 1) & (bin <= n_bins); }
+};
+
+/**
+ * Class for a 1D histogram with fixed binning,
+ * used in the event loop instead of TH1D.
+ *
+ * The bins are laid out as in ROOT (0 is the
+ * underflow, n_bins + 1 the overflow), so that
+ * the histogram can be copied into a TH1D at the end.
+ */
+class Hist1D
+{
+  private:
+    Axis axis;
+
+    std::vector<double> contents;
+
+    // statistics (as in TH1::GetStats)
+    double entries{};
+    double sum_w{};
+    double sum_w2{};
+    double sum_wx{};
+    double sum_wx2{};
+
+  public:
+    Hist1D() = default;
+    Hist1D(int n_bins, double x_min, double x_max);
+    ~Hist1D() = default;
+
+    /**
+     * Function for adding a value to the histogram.
+     *
+     * @param[in] x The value.
+     * @param[in] w The weight.
+     */
+    void fill(double x, double w = 1.0)
+    {
+        int bin = axis.find_bin(x);
+        contents[bin] += w;
+
+        double w_in = w * axis.in_range(bin);
+        entries += 1;
+        sum_w += w_in;
+        sum_w2 += w_in * w;
+        sum_wx += w_in * x;
+        sum_wx2 += w_in * x * x;
+    }
+
+    void fill_n(data::Span<double> values, bool positive_only = false);
+    void add(const Hist1D &other);
+    void reset();
+    void to_root(TH1 *hist) const;
+};
+
+/**
+ * Class for a 2D histogram with fixed binning,
+ * used in the event loop instead of TH2D.
+ *
+ * The bins are laid out as in ROOT
+ * (global bin = bin_x + (n_bins_x + 2) * bin_y).
+ */
+class Hist2D
+{
+  private:
+    Axis axis_x;
+    Axis axis_y;
+
+    std::vector<double> contents;
+    std::vector<double> errors2; // sum of the squared weights
+
+    // statistics (as in TH2::GetStats)
+    double entries{};
+    double sum_w{};
+    double sum_w2{};
+    double sum_wx{};
+    double sum_wx2{};
+    double sum_wy{};
+    double sum_wy2{};
+    double sum_wxy{};
+
+  public:
+    Hist2D() = default;
+    Hist2D(int n_bins_x, double x_min, double x_max, int n_bins_y, double y_min, double y_max);
+    ~Hist2D() = default;
+
+    /**
+     * Function for adding a value to the histogram.
+     *
+     * @param[in] x The x value.
+     * @param[in] y The y value.
+     * @param[in] w The weight.
+     */
+    void fill(double x, double y, double w = 1.0)
+    {
+        int bin_x = axis_x.find_bin(x);
+        int bin_y = axis_y.find_bin(y);
+        int bin = bin_x + (axis_x.n_bins + 2) * bin_y;
+        contents[bin] += w;
+        errors2[bin] += w * w;
+
+        double w_in = w * (axis_x.in_range(bin_x) & axis_y.in_range(bin_y));
+        entries += 1;
+        sum_w += w_in;
+        sum_w2 += w_in * w;
+        sum_wx += w_in * x;
+        sum_wx2 += w_in * x * x;
+        sum_wy += w_in * y;
+        sum_wy2 += w_in * y * y;
+        sum_wxy += w_in * x * y;
+    }
+
+    void add(const Hist2D &other);
+    void reset();
+    void to_root(TH2 *hist) const;
+};
+} // namespace graphs
@@ -16,6 +16,24 @@ class Options
     bool verbosity;
     bool opt_verbose;
     bool use_probabilities;
+    bool batch_mode;
+    int n_threads;
+    bool text_dumps;
+    bool reconstruction_only;
+    bool event_cache;
+    // only set from the command line
+    std::string sweep_file;
+    std::string calibration_file;
+    long long calibration_entries = 0;
+    bool pixel_map = false;
+    int cluster_connectivity = 0; // 0 if the clusters are not searched
+    double cluster_threshold = 0;
+    int psf_radius = 1;
+    double min_photon_energy = 0; // no cut if max <= min
+    double max_photon_energy = 0;
+    int min_hits = 0;
+    int max_hits = -1; // no cut if negative
+    bool psf_hit = false;
 
     Options();
 
@@ -34,6 +52,7 @@ class Options
 
     void print_options() const;
     void change_options();
+    void parse_arguments(int argc, char **argv);
 
     std::string get_filename() const { return filename; }
     int get_n_thresholds() const { return n_thresholds; }
@@ -42,5 +61,23 @@ class Options
     double get_threshold_step() const { return threshold_step; }
     bool get_verbosity() const { return verbosity; }
     bool get_use_probabilities() const { return use_probabilities; }
+    bool get_batch_mode() const { return batch_mode; }
+    int get_n_threads() const { return n_threads; }
+    bool get_text_dumps() const { return text_dumps; }
+    bool get_reconstruction_only() const { return reconstruction_only; }
+    bool get_event_cache() const { return event_cache; }
+    std::string get_sweep_file() const { return sweep_file; }
+    std::string get_calibration_file() const { return calibration_file; }
+    long long get_calibration_entries() const { return calibration_entries; }
+    bool get_pixel_map() const { return pixel_map; }
+    int get_cluster_connectivity() const { return cluster_connectivity; }
+    double get_cluster_threshold() const { return cluster_threshold; }
+    int get_psf_radius() const { return psf_radius; }
+    double get_min_photon_energy() const { return min_photon_energy; }
+    double get_max_photon_energy() const { return max_photon_energy; }
+    int get_min_hits() const { return min_hits; }
+    int get_max_hits() const { return max_hits; }
+    bool get_psf_hit() const { return psf_hit; }
+    bool get_calibration_mode() const { return !calibration_file.empty() || calibration_entries > 0; }
 };
 } // namespace options
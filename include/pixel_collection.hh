@@ -1,9 +1,15 @@
 #pragma once
 
 #include "constants.hh"
+#include "correlation_matrix.hh"
+#include "counter_array.hh"
 #include "data.hh"
+#include "solve_system.hh"
 
 #include <array>
+#include <cmath>
+#include <ostream>
+#include <string>
 #include <vector>
 
 namespace pixel
@@ -14,49 +20,168 @@ namespace pixel
  * relative to an event.
  */
 struct EventCounts {
-    int type; // The type of pixel (0, T, TR,...)
+    int type; // The type of pixel (0, T, TR)
     int bin;  // The energy bin
 
     void reset() { bin = -1; }
 };
 
+/**
+ * Structure containing the energy
+ * binning of a pixel collection.
+ */
+struct Binning {
+    int n_thresholds;
+    double min_threshold;
+    double max_threshold;
+
+    // Returns the width of the bins.
+    double get_step() const { return (n_thresholds) ? (max_threshold - min_threshold) / n_thresholds : 0; }
+    // Returns the # of whole bins below MIN_THR, by which the bin of the sum of two energies is shifted.
+    int get_sum_offset() const
+    {
+        return (get_step() > 0) ? static_cast<int>(std::floor(min_threshold / get_step() + 1e-9)) : 0;
+    }
+
+    static Binning from_options();
+    static std::vector<Binning> read_file(const std::string &path);
+};
+
+/**
+ * Structure mapping the energies to the bins of a binning.
+ *
+ * The energies below MIN_THR go to the underflow bin (-1) and the
+ * ones from MAX_THR on to the overflow bin (N), so the index is always
+ * in [-1, N]. The bin is computed with a multiplication by the inverse
+ * of the step and two clamps, with no branches, so the loop over the
+ * energies of an event is vectorized.
+ */
+struct BinIndexer {
+    static constexpr int UNDERFLOW_BIN = -1;
+
+    double offset = 0;       // MIN_THR
+    double inverse_step = 0; // 1 / width of the bins
+    int n_bins = 0;          // also the overflow bin
+
+    BinIndexer() = default;
+    BinIndexer(const Binning &binning)
+        : offset(binning.min_threshold)
+        , inverse_step((binning.get_step() > 0) ? 1.0 / binning.get_step() : 0.0)
+        , n_bins(binning.n_thresholds)
+    {
+    }
+
+    // Returns the bin of the energy, in [-1, N].
+    int operator()(double energy) const
+    {
+        double x = (energy - offset) * inverse_step;
+        x = (x > -1.0) ? x : -1.0; // also sends NaN to the underflow
+        x = (x < n_bins) ? x : n_bins;
+
+        // truncation is the floor on [0, N + 1]
+        return static_cast<int>(x + 1.0) - 1;
+    }
+
+    /**
+     * Function for computing the bins
+     * of an array of energies.
+     *
+     * @param[in] energies The energies.
+     * @param[out] bins The bins, with room for n values.
+     * @param[in] n The number of energies.
+     */
+    void operator()(const double *energies, int *bins, std::size_t n) const
+    {
+        for (std::size_t i = 0; i < n; i++)
+            bins[i] = (*this)(energies[i]);
+    }
+};
+
 /**
  * Class used for reconstructing
  * the energy spectrum of the
  * photons used in the simulation.
+ *
+ * With the whole array illuminated, every interior
+ * pixel is used as pixel 0, with its own T and TR pixels,
+ * and all of them are accumulated in the same counters.
+ *
+ * The reconstruction uses only 0, T and TR; with a larger
+ * PSF the spectra of the outer classes are only counted.
  */
 class PixelCollection
 {
   private:
-    double bin_size{};
-
-    std::array<std::vector<int>, MAX_PSF_ELEMENTS> energy_measured;
-    std::array<std::vector<int>, MAX_PSF_ELEMENTS> energy_corrected;
-    std::array<std::vector<std::vector<int>>, MAX_PSF_ELEMENTS - 1> counts_and;
-    std::vector<std::vector<double>> transition_probabilities;
+    Binning binning;
+    BinIndexer indexer;
+
+    // 32-bit cells spilling to 64-bit counters, so merged datasets of any size are counted exactly
+    std::array<CounterArray<std::uint32_t>, MAX_PSF_ELEMENTS> energy_measured;
+    std::array<std::vector<long long>, MAX_PSF_ELEMENTS> energy_corrected;
+    // hits below MIN_THR and from MAX_THR on, which are not in the spectra
+    std::array<long long, MAX_PSF_ELEMENTS> underflow{};
+    std::array<long long, MAX_PSF_ELEMENTS> overflow{};
+    // outer classes of a PSF larger than 3x3 ([role - MAX_PSF_ELEMENTS]), central beam only,
+    // which are saved but not used in the reconstruction
+    std::vector<CounterArray<std::uint32_t>> energy_outer;
+    // coincidences of 0 with the T pixels ([0]) and with the TR pixels ([1]), summed over the 4 pixels
+    std::array<CorrelationMatrix, MAX_PSF_ELEMENTS - 1> counts_and;
+    // coincidences of 0 with a T pixel and a TR pixel next to it (the corners of 0), summed over the 8 pairs
+    CoincidenceTensor counts_and_t_tr;
+    // sums of counts_and[0] updated with it, over the bins (i, j) with i + j + sum_offset in [0, N)
+    std::vector<long long> anti_diagonal_sums; // [i + j + sum_offset]
+    std::vector<long long> column_sums;        // [j]
+    int sum_offset; // the energies of 0 and T in the bins i and j add up to the bin i + j + sum_offset
+    solve_system::TransitionProbabilities transition_probabilities; // only the nonzero cells
 
     std::shared_ptr<data::PSFInfo> psf_info;
+    bool flood; // whole array illuminated
+    // loop over the hits of an event, specialized for the radius of the PSF
+    void (PixelCollection::*fill_kernel)(data::Span<Int_t> ids, const int *bins);
 
-    std::array<EventCounts, MAX_PSF_ELEMENTS> event_counts;
+    // one slot for 0, then one for each T and each TR pixel
+    std::array<EventCounts, PSF_PIXELS> event_counts;
+    // flood illumination: bin of each pixel in the current event (-1 if not hit) and pixels hit
+    std::vector<int> event_bins;
+    std::vector<int> event_hits;
+    std::vector<int> hit_bins; // bins of the hits of the current event
 
     static bool verbose;
 
-    int get_bin(double energy) const { return energy / bin_size; }
-    void fill_collection(double energy, int type);
+    template <int RADIUS> void fill_hits_radius(data::Span<Int_t> ids, const int *bins);
+    void fill_hit(const data::PixelInfo &pixel, int bin);
+    void fill_collection(int bin, int type);
+    void add_coincidence(int type, int bin_0, int bin);
+    void end_event_flood();
 
     void print_correlations() const;
 
   public:
-    PixelCollection(std::shared_ptr<data::PSFInfo> psf);
+    PixelCollection(std::shared_ptr<data::PSFInfo> psf, const Binning &binning, int beam_width);
     ~PixelCollection() = default;
 
-    void add_event(std::vector<int> v_id, std::vector<double> v_energy);
-    void reconstruct_spectrum(int beam_width);
+    void begin_event();
+    void fill_hits(data::Span<Int_t> ids, data::Span<Double_t> energies);
+    void end_event();
+    void merge(const PixelCollection &other);
+    void reset();
+    void compute_transition_probabilities();
+    void apply_transition_probabilities(const solve_system::Solver &solver);
     void print_counts() const;
-    void save_output();
-
+    void save_output(bool save_probabilities);
+    void save_spectrum(std::ostream &file, int config) const;
+
+    // Get the binning
+    const Binning &get_binning() const { return binning; }
+    // Get the bins of the hits of the last event filled
+    data::Span<int> get_hit_bins() const { return hit_bins; }
+    // Get the transition probabilities (`compute_transition_probabilities()` must be called first)
+    const solve_system::TransitionProbabilities &get_transition_probabilities() const
+    {
+        return transition_probabilities;
+    }
     // Get the reconstructed spectrum
-    std::vector<int> get_energy_corrected() const { return energy_corrected[0]; }
+    std::vector<long long> get_energy_corrected() const { return energy_corrected[0]; }
 
     // Set verbosity of the class
     static void set_verbose(bool value) { verbose = value; }
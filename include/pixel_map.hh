@@ -0,0 +1,68 @@
+#pragma once
+
+#include "correlation_matrix.hh"
+#include "counter_array.hh"
+#include "data.hh"
+#include "pixel_collection.hh"
+#include "solve_system.hh"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace pixel
+{
+/**
+ * Class used for reconstructing the energy
+ * spectrum of every pixel of the array.
+ *
+ * The spectra are stored in one contiguous [pixel][bin]
+ * block, so the memory grows as n_pixel^2 * N; most of the
+ * counts of a pixel are small, so they are kept in 16-bit
+ * cells that spill to 64-bit counters on saturation.
+ *
+ * The 0-T coincidences of each pixel are kept in a sparse tensor
+ * keyed by (pixel, bin of the pixel, bin of T), since a dense
+ * matrix for each pixel would grow as n_pixel^2 * N^2: each pixel
+ * gets its own corrected counts and transition probabilities,
+ * so the differences between the pixels (e.g. at the edges of
+ * the array) are kept. With the probabilities of a calibration
+ * every pixel is instead reconstructed with the same ones.
+ */
+class PixelMap
+{
+  private:
+    Binning binning;
+    std::shared_ptr<data::PSFInfo> psf_info;
+
+    CounterArray<std::uint16_t> energy_measured; // [pixel][bin]
+    std::vector<double> energy_corrected; // [pixel][bin]
+
+    CoincidenceTensor counts_and; // 0-T coincidences, key (pixel, bin of the pixel, bin of T)
+    std::vector<solve_system::TransitionProbabilities> transition_probabilities; // [pixel]
+
+    // bin of each pixel in the current event (-1 if not hit) and pixels hit
+    std::vector<int> event_bins;
+    std::vector<int> event_hits;
+
+    static bool verbose;
+
+  public:
+    PixelMap(std::shared_ptr<data::PSFInfo> psf, const Binning &binning);
+    ~PixelMap() = default;
+
+    void fill_hits(data::Span<Int_t> ids, data::Span<int> bins);
+    void end_event();
+    void merge(const PixelMap &other);
+    void reset();
+    void compute_transition_probabilities(int n_threads);
+    void reconstruct_spectra(const solve_system::Solver &solver, int n_threads);
+    void save_output(const std::string &path) const;
+    void save_transition_probabilities(const std::string &path) const;
+
+    // Set verbosity of the class
+    static void set_verbose(bool value) { verbose = value; }
+};
+
+} // namespace pixel
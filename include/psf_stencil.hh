@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+
+namespace data
+{
+/**
+ * Structure containing the offsets of the pixels around
+ * pixel 0 within a PSF of radius `RADIUS` ((2R + 1) x (2R + 1)
+ * pixels), generated at compile time.
+ *
+ * The offsets are grouped in classes of pixels equivalent by
+ * symmetry, i.e. with the same (min(|dx|, |dy|), max(|dx|, |dy|)),
+ * ordered by distance: T (0, 1), TR (1, 1), then (0, 2), (1, 2),
+ * (2, 2), (0, 3) and so on. The class c is the role c + 1, and in
+ * each class the offsets are in row-major order, so the first two
+ * classes match `PSFInfo::id_pixel_t` and `PSFInfo::id_pixel_tr`.
+ */
+template <int RADIUS> struct PSFStencil {
+    static_assert(RADIUS >= 1, "the PSF contains at least the T and TR pixels");
+
+    static constexpr int SIDE = 2 * RADIUS + 1;
+    static constexpr int N_OFFSETS = SIDE * SIDE - 1;
+    static constexpr int N_CLASSES = (RADIUS + 1) * (RADIUS + 2) / 2 - 1;
+
+    struct Offset {
+        int dx;
+        int dy;
+        int role;  // class + 1
+        int index; // index among the pixels of the class
+    };
+
+    // Returns the class of the offset (dx, dy), not (0, 0).
+    static constexpr int get_class(int dx, int dy)
+    {
+        int a = (dx < 0) ? -dx : dx;
+        int b = (dy < 0) ? -dy : dy;
+        int low = (a < b) ? a : b;
+        int high = (a < b) ? b : a;
+        return high * (high + 1) / 2 + low - 1;
+    }
+
+    static constexpr std::array<Offset, N_OFFSETS> make_offsets()
+    {
+        std::array<Offset, N_OFFSETS> offsets{};
+        int n = 0;
+        for (int c = 0; c < N_CLASSES; c++) {
+            int index = 0;
+            for (int dy = -RADIUS; dy <= RADIUS; dy++) {
+                for (int dx = -RADIUS; dx <= RADIUS; dx++) {
+                    if ((dx || dy) && get_class(dx, dy) == c) offsets[n++] = {dx, dy, c + 1, index++};
+                }
+            }
+        }
+
+        return offsets;
+    }
+
+    static constexpr std::array<Offset, N_OFFSETS> offsets = make_offsets();
+};
+
+// the first two classes are the T and TR pixels
+static_assert(PSFStencil<1>::N_CLASSES == 2 && PSFStencil<2>::N_CLASSES == 5 && PSFStencil<3>::N_CLASSES == 9);
+static_assert(PSFStencil<1>::offsets[0].dy == -1 && PSFStencil<1>::offsets[1].dx == -1 &&
+              PSFStencil<1>::offsets[4].role == 2 && PSFStencil<3>::offsets[47].role == 9);
+} // namespace data
@@ -1,8 +1,10 @@
 #pragma once
 
-#include "TMatrixD.h"
 #include "options.hh"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <sstream>
@@ -14,92 +16,206 @@ const std::filesystem::path prob_path{"../output/transition_probabilities.csv"};
 
 namespace solve_system
 {
+/**
+ * Structure containing the transition probabilities
+ * as a sparse matrix, i.e. only the nonzero cells, in
+ * row-major order (row: bin of 0, column: bin of T).
+ */
+struct TransitionProbabilities {
+    struct Cell {
+        std::int32_t i;
+        std::int32_t j;
+        double probability;
+    };
+
+    int N = 0;
+    std::vector<Cell> cells;
+
+    // Returns whether the cell a comes before the cell b in row-major order.
+    static bool before(const Cell &a, const Cell &b) { return (a.i != b.i) ? a.i < b.i : a.j < b.j; }
+
+    // Returns the probability of the cell (i, j) (0 if not stored).
+    double operator()(int i, int j) const
+    {
+        auto it = std::lower_bound(cells.begin(), cells.end(), Cell{i, j, 0}, before);
+        return (it != cells.end() && it->i == i && it->j == j) ? it->probability : 0.0;
+    }
+};
+
 /**
  * Function for reading the trnasition
  * probabilities stored in the .csv file.
  *
- * @return The matrix with the probabilities.
+ * Only the nonzero cells are kept, so both the
+ * sparse files and the dense ones can be read.
+ *
+ * @return The probabilities.
  */
-inline TMatrixD read_file()
+inline TransitionProbabilities read_file()
 {
-    int N = options::Options::get_instance().get_n_thresholds();
-    TMatrixD probabilities(N, N);
+    TransitionProbabilities probabilities;
+    probabilities.N = options::Options::get_instance().get_n_thresholds();
 
     std::fstream probabilities_file;
     probabilities_file.open(prob_path, std::ios::in);
     if (!probabilities_file.is_open()) throw std::runtime_error("Impossible to open probabilities file.");
 
-    int row = -1;
-    int col = 0;
     std::string line;
+    std::getline(probabilities_file, line); // header
     while (std::getline(probabilities_file, line)) {
-        if (row < 0) {
-            row++;
-            continue;
-        }
-
         std::string buffer;
         std::stringstream input_line(line);
 
         std::getline(input_line, buffer, ',');
+        int i = std::stoi(buffer);
         std::getline(input_line, buffer, ',');
+        int j = std::stoi(buffer);
         std::getline(input_line, buffer, ',');
+        double probability = std::stod(buffer);
 
-        probabilities(row, col) = std::stod(buffer.c_str());
-
-        if (col < N - 1) {
-            col++;
-        } else {
-            col = 0;
-            row++;
-        }
+        if (i < 0 || j < 0 || i >= probabilities.N || j >= probabilities.N)
+            throw std::runtime_error("The probabilities file does not match N_THR.");
+        if (probability != 0) probabilities.cells.push_back({i, j, probability});
     }
 
+    std::sort(probabilities.cells.begin(), probabilities.cells.end(), TransitionProbabilities::before);
+
     return probabilities;
 }
 
-/*
- * Function for getting the matrix that
- * defines the system to be solved.
+// # of spectra solved together by Solver::solve_batch
+constexpr int SOLVE_BLOCK_SIZE = 64;
+
+/**
+ * Class for solving the linear system necessary
+ * for the spectrum reconstruction from the transition
+ * probabilities.
  *
- * @return Said matrix.
+ * The system matrix is upper triangular, with K(i, j)
+ * in the cell (j, i) for i > j, so it is built once from
+ * the nonzero probabilities and stored as compressed rows
+ * with the inverse of its diagonal; each spectrum is then
+ * reconstructed with a back-substitution in double precision.
  */
-inline TMatrixD get_system_matrix()
+class Solver
 {
-    int N = options::Options::get_instance().get_n_thresholds();
-    TMatrixD system_matrix(N, N);
-    const TMatrixD &K = read_file();
+  private:
+    int N;
+    std::vector<int> row_start;           // [row], first entry of the row in columns and values
+    std::vector<int> columns;             // column of each entry above the diagonal
+    std::vector<double> values;           // value of each entry above the diagonal
+    std::vector<double> inverse_diagonal; // 1 / system_matrix(i, i)
+
+  public:
+    /**
+     * The default constructor.
+     *
+     * The diagonal of the row i uses the cells of the anti-diagonal
+     * i where 0 or T is in the bin 0, which is shifted by the bins
+     * below MIN_THR (see `pixel::Binning::get_sum_offset()`).
+     *
+     * @param[in] K The transition probabilities.
+     * @param[in] sum_offset The # of whole bins below MIN_THR.
+     */
+    Solver(const TransitionProbabilities &K, int sum_offset)
+        : N(K.N)
+        , row_start(N + 1, 0)
+        , inverse_diagonal(N, 0.0)
+    {
+        bool verbose = options::Options::get_instance().get_verbosity();
+        bool invertible = true;
+
+        for (int row = 0; row < N; row++) {
+            int bin = row - sum_offset;
+            double diagonal = (bin >= 0) ? 1 + 0.5 * K(bin, 0) - 0.5 * std::max(row - 1, 0) * K(0, bin) : 1;
+            if (!diagonal) invertible = false;
+            inverse_diagonal[row] = 1.0 / diagonal;
+        }
 
-    if (options::Options::get_instance().get_verbosity()) K.Print();
+        // system_matrix(j, i) = K(i, j) for i > j
+        for (const auto &cell : K.cells)
+            if (cell.i > cell.j) row_start[cell.j + 1]++;
+        for (int row = 0; row < N; row++)
+            row_start[row + 1] += row_start[row];
 
-    bool invertible = true;
+        columns.resize(row_start[N]);
+        values.resize(row_start[N]);
+        std::vector<int> next(row_start.begin(), row_start.end() - 1);
+        for (const auto &cell : K.cells) {
+            if (cell.i <= cell.j) continue;
 
-    for (int row = 0; row < N; row++) {
-        for (int col = row; col < N; col++) {
+            columns[next[cell.j]] = cell.i;
+            values[next[cell.j]++] = cell.probability;
+        }
 
-            if (col == row) {
-                double first = 1 + 0.5 * K(row, 0);
-                for (int j = 1; j < row; j++)
-                    first -= 0.5 * K(row - col, col);
+        if (verbose) {
+            printf("Transition probabilities: %zu nonzero cells\n", K.cells.size());
+            for (const auto &cell : K.cells)
+                printf("K(%i, %i) = %g\n", cell.i, cell.j, cell.probability);
 
-                system_matrix(row, col) = first;
+            (invertible) ? printf("The matrix is invertible\n") : printf("The matrix is not invertible\n");
+        }
+    }
 
-                if (!first) invertible = false;
-                continue;
+    // Returns the number of bins.
+    int get_n_bins() const { return N; }
+
+    /**
+     * Function for solving the system for many spectra.
+     *
+     * The spectra are processed in blocks of `SOLVE_BLOCK_SIZE`,
+     * transposed to [bin][spectrum] so that each row of the matrix
+     * is applied to the whole block with a contiguous inner loop.
+     *
+     * @param[in] counts The measured counts, [spectrum][bin].
+     * @param[out] results The corrected counts, [spectrum][bin].
+     * @param[in] n_spectra The number of spectra.
+     */
+    void solve_batch(const double *counts, double *results, int n_spectra) const
+    {
+        std::vector<double> block(static_cast<std::size_t>(N) * SOLVE_BLOCK_SIZE);
+
+        for (int first = 0; first < n_spectra; first += SOLVE_BLOCK_SIZE) {
+            int n = std::min(SOLVE_BLOCK_SIZE, n_spectra - first);
+
+            for (int row = N - 1; row > -1; row--) {
+                double *x_row = &block[row * SOLVE_BLOCK_SIZE];
+                for (int s = 0; s < n; s++)
+                    x_row[s] = counts[(first + s) * N + row];
+
+                // the counts moved to the higher bins are given back
+                for (int e = row_start[row]; e < row_start[row + 1]; e++) {
+                    double u = values[e];
+                    const double *x_j = &block[columns[e] * SOLVE_BLOCK_SIZE];
+                    for (int s = 0; s < n; s++)
+                        x_row[s] += u * x_j[s];
+                }
+
+                for (int s = 0; s < n; s++)
+                    x_row[s] *= inverse_diagonal[row];
             }
 
-            system_matrix(row, col) += K(col, row);
+            for (int s = 0; s < n; s++) {
+                for (int row = 0; row < N; row++)
+                    results[(first + s) * N + row] = block[row * SOLVE_BLOCK_SIZE + s];
+            }
         }
     }
 
-    if (options::Options::get_instance().get_verbosity()) {
-        system_matrix.Print();
-
-        (invertible) ? printf("The matrix is invertible\n") : printf("The matrix is not invertible\n");
+    /**
+     * Function for solving the system for a spectrum.
+     *
+     * @param[in] counts The measured counts.
+     * @return The corrected counts.
+     */
+    std::vector<double> solve(const std::vector<double> &counts) const
+    {
+        std::vector<double> results(N);
+        solve_batch(counts.data(), results.data(), 1);
+
+        return results;
     }
-
-    return system_matrix;
-}
+};
 
 /**
  * Function for solving the linear system necessary
@@ -107,33 +223,27 @@ inline TMatrixD get_system_matrix()
  * probabilities.
  *
  * @param[in] counts The measured counts.
- * @return The corrected counts.
+ * @param[in] solver The solver built from the transition probabilities.
+ * @return The corrected counts, rounded to the closest integer.
  */
-inline std::vector<int> solve(std::vector<int> counts)
+inline std::vector<long long> solve(const std::vector<double> &counts, const Solver &solver)
 {
-    int N = options::Options::get_instance().get_n_thresholds();
-    std::vector<int> reconstructed_counts(N, 0);
-    const TMatrixD &system_matrix = get_system_matrix();
-
     if (options::Options::get_instance().get_verbosity()) {
         printf("Measured counts\n");
-        for (int e : counts) {
-            printf("%i\n", e);
+        for (double e : counts) {
+            printf("%.0f\n", e);
         }
     }
 
-    for (int row = N - 1; row > -1; row--) {
-        double factor = 0;
-        for (int j = row + 1; j < N; j++)
-            factor -= system_matrix(row, j) * reconstructed_counts[j];
-
-        reconstructed_counts[row] = (counts[row] - factor) / system_matrix(row, row);
-    }
+    const std::vector<double> &reconstructed = solver.solve(counts);
+    std::vector<long long> reconstructed_counts(reconstructed.size());
+    for (int i = 0; i < reconstructed.size(); i++)
+        reconstructed_counts[i] = std::llround(reconstructed[i]);
 
     if (options::Options::get_instance().get_verbosity()) {
         printf("Reconstructed counts\n");
-        for (int e : reconstructed_counts) {
-            printf("%i\n", e);
+        for (long long e : reconstructed_counts) {
+            printf("%lld\n", e);
         }
     }
 
@@ -1,8 +1,11 @@
 #include "TApplication.h"
+#include "TROOT.h"
 #include "analysis.hh"
+#include "options.hh"
 
 #include <filesystem>
 #include <iostream>
+#include <memory>
 
 int main(int argc, char **argv)
 {
@@ -10,9 +13,22 @@ int main(int argc, char **argv)
     std::filesystem::create_directory("../output/");
     std::filesystem::create_directory("../results/");
     std::filesystem::create_directory("../utils/");
+    std::filesystem::create_directory("../calibrations/");
 
-    printf("\033c");
-    TApplication app("app", &argc, argv);
+    options::Options &opt = options::Options::get_instance();
+    opt.parse_arguments(argc, argv);
+    bool batch = opt.get_batch_mode();
+
+    // no GUI event loop in batch mode
+    std::unique_ptr<TApplication> app;
+    if (batch) {
+        gROOT->SetBatch(true);
+        if (opt.get_n_threads() > 1) ROOT::EnableThreadSafety();
+    } else {
+        printf("\033c");
+        int app_argc = 1;
+        app = std::make_unique<TApplication>("app", &app_argc, argv);
+    }
 
     analysis::Analysis analysis = analysis::Analysis();
 
@@ -24,7 +40,7 @@ int main(int argc, char **argv)
         return 1;
     }
 
-    app.Run();
+    if (!batch) app->Run();
 
     return 0;
 }
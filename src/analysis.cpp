@@ -1,26 +1,186 @@
 #include "analysis.hh"
 
+#include "TEnv.h"
 #include "TFile.h"
 #include "TTree.h"
 #include "constants.hh"
 #include "options.hh"
 #include "pixel_collection.hh"
-#include "reference.hh"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
-#include <tuple>
+#include <thread>
+#include <vector>
+
+/**
+ * Function for opening the event cache of a ROOT
+ * file (in `data::CACHE_DIRECTORY`), converting the
+ * Event tree if the cache is missing or stale.
+ *
+ * @param[in] hits_tree The pointer to the Event TTree.
+ * @param[in] path The path of the ROOT file.
+ * @return The pointer to the cache (null if it cannot be used).
+ */
+static std::shared_ptr<const data::EventCache> open_event_cache(TTree *hits_tree, const std::string &path)
+{
+    std::filesystem::path cache_file = std::filesystem::path(path).filename().replace_extension(".evc");
+    std::string cache_path = std::filesystem::path(data::CACHE_DIRECTORY) / cache_file;
+    try {
+        if (!data::EventCache::is_valid(cache_path, path)) data::EventCache::build(hits_tree, cache_path, path);
+        return std::make_shared<const data::EventCache>(cache_path);
+    } catch (std::runtime_error &) {
+        printf("%sWARNING - Reading the events from the ROOT file.%s\n", WARNING_COLOR, END_COLOR);
+        return nullptr;
+    }
+}
+
+/**
+ * Function for opening the reader of a worker,
+ * on the event cache when available or else on
+ * its own copy of the ROOT file, since TTrees
+ * cannot be read by more than one thread.
+ *
+ * @param[out] worker The worker.
+ * @param[in] path The path of the ROOT file.
+ * @param[in] cache The pointer to the event cache of the file (null if not used).
+ * @param[in] profile The branches to read from the ROOT file.
+ */
+static void open_events(analysis::Worker &worker, const std::string &path,
+                        const std::shared_ptr<const data::EventCache> &cache, const data::IOProfile &profile)
+{
+    if (cache) {
+        worker.event = std::make_unique<data::Event>(cache);
+        return;
+    }
+
+    worker.file = std::make_unique<TFile>(path.c_str(), "READ");
+    if (!worker.file->IsOpen()) {
+        printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    worker.event_tree = static_cast<TTree *>(worker.file->Get("Event"));
+    if (!worker.event_tree) {
+        printf("%sERROR - Impossible to load TTree Event %s\n", ERROR_COLOR, END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    worker.event = std::make_unique<data::Event>(worker.event_tree, profile);
+}
+
+/**
+ * Function for running the event loop over a range
+ * of entries without printing them or waiting for
+ * the user's input.
+ *
+ * The entries are split into blocks of fixed size,
+ * which the threads process one at a time with their
+ * own accumulators. The blocks are merged into the
+ * final results in the order of the entries, so the
+ * results do not depend on the number of threads.
+ *
+ * @param[in] label The name of the loop, printed with the progress.
+ * @param[in] make_worker The function creating the reader and the accumulators of a thread.
+ * @param[in] kernel The event kernel.
+ * @param[in] psf The PSFInfo structure, used by the cuts.
+ * @param[in] cuts The cuts on the entries.
+ * @param[in] first_entry The first entry.
+ * @param[in] n_entries The number of entries.
+ * @param[out] hist The histograms the blocks are merged into (null if they are not kept).
+ * @param[out] pixel_collections The pixel collections the blocks are merged into.
+ * @param[out] pixel_map The pixel map the blocks are merged into (null if not used).
+ * @return The number of entries that passed the cuts.
+ */
+static Long64_t process_blocks(const char *label, const std::function<analysis::Worker()> &make_worker,
+                               const kernel::EventKernel &kernel, const data::PSFInfo &psf,
+                               const data::EventCuts &cuts, Long64_t first_entry, Long64_t n_entries,
+                               graphs::Histograms *hist, std::vector<pixel::PixelCollection> &pixel_collections,
+                               pixel::PixelMap *pixel_map)
+{
+    Long64_t n_blocks = (n_entries + EVENT_BLOCK_SIZE - 1) / EVENT_BLOCK_SIZE;
+    int n_threads = std::max(1, options::Options::get_instance().get_n_threads());
+    n_threads = std::min<Long64_t>(n_threads, std::max<Long64_t>(n_blocks, 1));
+
+    printf("%sINFO - %s: processing %lld entries with %i thread(s).%s\n", INFO_COLOR, label, n_entries, n_threads,
+           END_COLOR);
+
+    std::vector<analysis::Worker> workers;
+    for (int t = 0; t < n_threads; t++)
+        workers.push_back(make_worker());
+
+    std::atomic<Long64_t> n_selected{0};
+    std::atomic<Long64_t> next_block{0};
+    Long64_t next_merge = 0;
+    std::mutex merge_mutex;
+    std::condition_variable merge_condition;
+
+    auto process_worker_blocks = [&](analysis::Worker &worker) {
+        for (Long64_t block = next_block++; block < n_blocks; block = next_block++) {
+            Long64_t first = first_entry + block * EVENT_BLOCK_SIZE;
+            Long64_t last = std::min(first + EVENT_BLOCK_SIZE, first_entry + n_entries);
+
+            // the cache is filled only with the baskets of the block
+            worker.event->set_entry_range(first, last);
+            Long64_t n_block_selected = 0;
+            for (Long64_t i = first; i < last; i++) {
+                // the other branches are read only for the selected entries
+                if (cuts.enabled() && !worker.event->select(i, cuts, psf)) continue;
+
+                kernel.process(worker.event->read(i), *worker.hist, worker.pixel_collections, worker.pixel_map.get(),
+                               worker.cluster_finder.get());
+                n_block_selected++;
+            }
+            n_selected += n_block_selected;
+
+            // merge in the order of the blocks
+            std::unique_lock<std::mutex> lock(merge_mutex);
+            merge_condition.wait(lock, [&] { return next_merge == block; });
+
+            if (hist) hist->merge(*worker.hist);
+            for (int c = 0; c < pixel_collections.size(); c++)
+                pixel_collections[c].merge(worker.pixel_collections[c]);
+            if (pixel_map) pixel_map->merge(*worker.pixel_map);
+            next_merge++;
+            printf("%sINFO - %s: %lld entries processed.%s\n", INFO_COLOR, label, last - first_entry, END_COLOR);
+
+            lock.unlock();
+            merge_condition.notify_all();
+
+            worker.hist->reset();
+            for (pixel::PixelCollection &pixel_collection : worker.pixel_collections)
+                pixel_collection.reset();
+            if (worker.pixel_map) worker.pixel_map->reset();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (analysis::Worker &worker : workers)
+        threads.emplace_back(process_worker_blocks, std::ref(worker));
+
+    for (std::thread &thread : threads)
+        thread.join();
+
+    return n_selected;
+}
 
 /**
  * The default constructor.
  *
  * It allows the user to view and modify the
- * analysis options.
+ * analysis options (skipped in batch mode).
  */
 analysis::Analysis::Analysis()
 {
     // set options
     options::Options &opt = options::Options::get_instance();
+    if (opt.get_batch_mode()) return;
 
     std::string opt_choice;
     while (true) {
@@ -57,13 +217,114 @@ analysis::Analysis::~Analysis() { results_file->Close(); }
  * reconstruction of the spectrum through
  * the algorithm used.
  */
-void analysis::Analysis::show_results() const
+void analysis::Analysis::show_results()
+{
+    options::Options &opt = options::Options::get_instance();
+
+    if (calibration_probabilities || opt.get_use_probabilities()) {
+        solver = std::make_unique<const solve_system::Solver>(
+            (calibration_probabilities) ? *calibration_probabilities : solve_system::read_file(),
+            binnings[0].get_sum_offset());
+        pixel_collections[0].apply_transition_probabilities(*solver);
+    } else {
+        for (pixel::PixelCollection &pixel_collection : pixel_collections)
+            pixel_collection.compute_transition_probabilities();
+
+        // the probabilities of the events selected by the cuts are biased, so they are not saved
+        pixel_collections[0].save_output(!cuts.enabled());
+
+        // a batch run processes the whole file, so its probabilities are also a calibration of it
+        if (!cuts.enabled() && opt.get_batch_mode())
+            calibration::save(calibration::STORE_DIRECTORY, info->get_geometry(), binnings[0], info->get_beam_width(),
+                              calibration::source_key(results_path, -1), event->get_entries(),
+                              pixel_collections[0].get_transition_probabilities());
+        if (cuts.enabled())
+            printf("%sWARNING - The transition probabilities of a run with cuts are not saved.%s\n", WARNING_COLOR,
+                   END_COLOR);
+    }
+    if (pixel_collections.size() > 1) save_sweep();
+    if (pixel_map) save_pixel_map();
+
+    hist->fill_results(pixel_collections[0].get_energy_corrected());
+    hist->close_dumps();
+
+    if (opt.get_batch_mode()) hist->save_histograms("../output/histograms_" + opt.get_filename());
+    else hist->show_histograms();
+}
+
+/**
+ * Function for saving the spectra reconstructed
+ * with all the binnings to a .csv file (the binning
+ * of the options is the configuration 0).
+ */
+void analysis::Analysis::save_sweep() const
+{
+    const char *sweep_path = "../output/sweep_spectra.csv";
+
+    std::ofstream sweep_file(sweep_path);
+    if (!sweep_file.is_open()) {
+        printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, sweep_path, END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    sweep_file << "Config,N_THR,MIN_THR,MAX_THR,Bin,Counts,Corrected counts\n";
+    for (int i = 0; i < pixel_collections.size(); i++)
+        pixel_collections[i].save_spectrum(sweep_file, i);
+
+    printf("%sINFO - Saved the spectra of %zu binnings to %s.%s\n", INFO_COLOR, pixel_collections.size(), sweep_path,
+           END_COLOR);
+}
+
+/**
+ * Function for reconstructing the spectra of all the
+ * pixels and saving them to a .csv file: each pixel uses
+ * its own transition probabilities, computed from its
+ * coincidences, or those of the calibration.
+ */
+void analysis::Analysis::save_pixel_map()
+{
+    options::Options &opt = options::Options::get_instance();
+    int n_threads = std::max(1, opt.get_n_threads());
+
+    if (solver)
+        pixel_map->reconstruct_spectra(*solver, n_threads);
+    else {
+        pixel_map->compute_transition_probabilities(n_threads);
+
+        // the probabilities of the events selected by the cuts are biased, so they are not saved
+        if (!cuts.enabled()) pixel_map->save_transition_probabilities("../output/pixel_map_probabilities.csv");
+    }
+    pixel_map->save_output("../output/pixel_map.csv");
+}
+
+/**
+ * Function for creating one pixel
+ * collection for each binning.
+ */
+std::vector<pixel::PixelCollection> analysis::Analysis::make_pixel_collections() const
 {
-    pixel_collection->reconstruct_spectrum(info->get_beam_width());
-    if (!options::Options::get_instance().get_use_probabilities()) pixel_collection->save_output();
+    std::shared_ptr<data::PSFInfo> psf_info = info->get_psf_info();
 
-    hist->fill_results(pixel_collection->get_energy_corrected());
-    hist->show_histograms();
+    std::vector<pixel::PixelCollection> collections;
+    collections.reserve(binnings.size());
+    for (const pixel::Binning &binning : binnings)
+        collections.emplace_back(psf_info, binning, info->get_beam_width());
+
+    return collections;
+}
+
+/**
+ * Function for creating the cluster finder of
+ * a thread of the event loop, if the clusters
+ * are searched.
+ */
+std::unique_ptr<clustering::ClusterFinder> analysis::Analysis::make_cluster_finder() const
+{
+    const options::Options &opt = options::Options::get_instance();
+    if (!opt.get_cluster_connectivity()) return nullptr;
+
+    return std::make_unique<clustering::ClusterFinder>(info->get_psf_info(), opt.get_cluster_connectivity(),
+                                                       opt.get_cluster_threshold());
 }
 
 /**
@@ -80,7 +341,11 @@ void analysis::Analysis::get_trees()
     strncat(file_name, opt.get_filename().c_str(), 50);
     bool verbosity = opt.get_verbosity();
 
+    // prefetch the baskets of the next cache fill while the current one is processed
+    gEnv->SetValue("TFile.AsyncPrefetching", 1);
+
     // open file and get trees
+    results_path = file_name;
     results_file = std::make_unique<TFile>(file_name, "READ");
     if (!results_file->IsOpen()) {
         printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, file_name, END_COLOR);
@@ -100,10 +365,34 @@ void analysis::Analysis::get_trees()
     }
 
     // get data from trees
+    io_profile = data::IOProfile::from_options();
+    cuts = data::EventCuts::from_options();
     info = std::make_unique<data::Info>(info_tree);
-    event = std::make_unique<data::Event>(event_tree);
-    hist = std::make_unique<graphs::Histograms>(info->get_n_pixel(), info->get_psf_info());
-    pixel_collection = std::make_unique<pixel::PixelCollection>(info->get_psf_info());
+
+    // convert the Event tree the first time the file is analysed, then read the cache
+    if (opt.get_event_cache()) event_cache = open_event_cache(event_tree, results_path);
+
+    if (event_cache) event = std::make_unique<data::Event>(event_cache);
+    else event = std::make_unique<data::Event>(event_tree, io_profile);
+
+    // the spectrum is also reconstructed with the binnings of the sweep
+    binnings = {pixel::Binning::from_options()};
+    if (!opt.get_sweep_file().empty()) {
+        if (opt.get_use_probabilities() || opt.get_calibration_mode()) {
+            printf("%sERROR - The sweep needs USE_PROBABILITIES = 0 and no calibration%s\n", ERROR_COLOR, END_COLOR);
+            throw std::runtime_error("");
+        }
+
+        std::vector<pixel::Binning> sweep = pixel::Binning::read_file(opt.get_sweep_file());
+        binnings.insert(binnings.end(), sweep.begin(), sweep.end());
+        printf("%sINFO - Sweep over %zu binnings.%s\n", INFO_COLOR, sweep.size(), END_COLOR);
+    }
+
+    hist = std::make_unique<graphs::Histograms>(info->get_n_pixel(), info->get_psf_info(), binnings[0]);
+    pixel_collections = make_pixel_collections();
+    if (opt.get_pixel_map()) pixel_map = std::make_unique<pixel::PixelMap>(info->get_psf_info(), binnings[0]);
+    cluster_finder = make_cluster_finder();
+    event_kernel = std::make_unique<kernel::EventKernel>(info->get_n_pixel(), info->get_psf_info(), io_profile);
 
     // set verbosity
     if (verbosity) {
@@ -111,65 +400,216 @@ void analysis::Analysis::get_trees()
         data::Event::set_verbose(true);
         graphs::Histograms::set_verbose(true);
         pixel::PixelCollection::set_verbose(true);
+        pixel::PixelMap::set_verbose(true);
+        clustering::ClusterFinder::set_verbose(true);
+        kernel::EventKernel::set_verbose(true);
     }
 }
 
 /**
- * Function for running the data analysis.
+ * Function for computing the key of the calibration
+ * dataset, which is either the whole calibration file
+ * or the first entries of the input file.
+ *
+ * @return The key of the dataset.
  */
-void analysis::Analysis::run() const
+std::uint64_t analysis::Analysis::calibration_key() const
 {
+    const options::Options &opt = options::Options::get_instance();
 
-    std::string choice = " ";
-    for (int i = 0; i < event_tree->GetEntries(); i++) {
-        if (choice == 'e') std::exit(0);
+    if (!opt.get_calibration_file().empty())
+        return calibration::source_key("../results/" + opt.get_calibration_file(), -1);
 
-        if (choice == 's') break;
+    Long64_t n_entries = std::min<Long64_t>(opt.get_calibration_entries(), event->get_entries());
+    return calibration::source_key(results_path, n_entries);
+}
 
-        event_tree->GetEntry(i);
-        if (i % 10'000 == 0 && i != 0) printf("%sINFO - %i entries processed.%s\n", INFO_COLOR, i, END_COLOR);
+/**
+ * Function for computing the transition probabilities
+ * in memory from the calibration dataset, which is either
+ * another ROOT file or the first entries of the input file
+ * (the measurement then starts after them).
+ *
+ * The entries are processed on all the threads as
+ * in batch mode (see `process_blocks()`), and the
+ * probabilities are then used for the reconstruction
+ * in place of the ones saved to the .csv file.
+ */
+void analysis::Analysis::calibrate()
+{
+    options::Options &opt = options::Options::get_instance();
+
+    // only the charge sharing hits are needed
+    data::IOProfile profile{false, false, false};
+
+    std::unique_ptr<TFile> calibration_file;
+    std::string calibration_path = results_path;
+    std::shared_ptr<const data::EventCache> calibration_cache = event_cache;
+    Long64_t n_entries;
+    int calibration_beam_width = info->get_beam_width();
+
+    if (!opt.get_calibration_file().empty()) {
+        std::string path = "../results/" + opt.get_calibration_file();
+        calibration_file = std::make_unique<TFile>(path.c_str(), "READ");
+        if (!calibration_file->IsOpen()) {
+            printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+            throw std::runtime_error("");
+        }
 
-        data::Entry entry = event->get_entry();
-        if (entry.id_pixel.size()) {
-            const auto [ids, energies] = reference_algorithm::cluster(
-                std::make_tuple(entry.id_pixel_cs, entry.pixel_energy_cs), info->get_n_pixel());
-            hist->fill_reference(ids, energies);
+        TTree *calibration_tree = static_cast<TTree *>(calibration_file->Get("Event"));
+        if (!calibration_tree) {
+            printf("%sERROR - Impossible to load TTree Event %s\n", ERROR_COLOR, END_COLOR);
+            throw std::runtime_error("");
         }
 
-        if (choice != 'g') {
-            (i != 0) ? printf("\033c") : printf("");
-            printf("Entry number = %i\n", i);
-            printf("Event ID = %i\n\n", entry.event_id);
-
-            printf("%sNO CHARGE SHARING%s\n", BOLD, END_COLOR);
-            printf("-----------------\n");
-            hist->fill_histograms(entry.id_pixel, entry.pixel_energy, false, true);
-
-            printf("\n%sWITH CHARGE SHARING%s\n", BOLD, END_COLOR);
-            printf("-------------------\n");
-            hist->fill_histograms(entry.id_pixel_cs, entry.pixel_energy_cs, true, true);
-
-            printf("\n");
-            pixel_collection->add_event(entry.id_pixel_cs, entry.pixel_energy_cs);
-            hist->fill_photon_energy(entry.photon_energy);
-
-            // CHOICE
-            printf("\nType:\n");
-            printf("- 's' to stop\n");
-            printf("- 'g' to go until the end (no print)\n");
-            printf("- 'e' to exit\n");
-            printf("- anything else to continue\n");
-            std::getline(std::cin, choice);
-            if (choice.length() == 0) continue;
+        // the calibration must come from the same detector
+        TTree *calibration_info_tree = static_cast<TTree *>(calibration_file->Get("Info"));
+        if (!calibration_info_tree) {
+            printf("%sERROR - Impossible to load TTree Info %s\n", ERROR_COLOR, END_COLOR);
+            throw std::runtime_error("");
         }
+        data::Info calibration_info(calibration_info_tree);
+        if (!calibration::same_geometry(calibration_info.get_geometry(), info->get_geometry())) {
+            printf("%sERROR - The geometry of %s does not match the one of the input file%s\n", ERROR_COLOR,
+                   path.c_str(), END_COLOR);
+            throw std::runtime_error("");
+        }
+        calibration_beam_width = calibration_info.get_beam_width();
+
+        // the workers open their own copies of the file
+        calibration_path = path;
+        calibration_cache = (opt.get_event_cache()) ? open_event_cache(calibration_tree, path) : nullptr;
+        n_entries = (calibration_cache) ? calibration_cache->get_entries() : calibration_tree->GetEntries();
+    } else {
+        n_entries = std::min<Long64_t>(opt.get_calibration_entries(), event->get_entries());
+        first_entry = n_entries;
+    }
+
+    // the cuts are not applied, so the calibration is computed from all the n_entries entries
+    // the histograms of the calibration are not kept
+    kernel::EventKernel calibration_kernel(info->get_n_pixel(), info->get_psf_info(), profile);
+    std::vector<pixel::PixelCollection> calibration_collection;
+    calibration_collection.emplace_back(info->get_psf_info(), binnings[0], calibration_beam_width);
+
+    auto make_calibration_worker = [&] {
+        Worker worker;
+        worker.hist = hist->make_worker_copy();
+        worker.pixel_collections.emplace_back(info->get_psf_info(), binnings[0], calibration_beam_width);
+        open_events(worker, calibration_path, calibration_cache, profile);
+        return worker;
+    };
+    process_blocks("Calibration", make_calibration_worker, calibration_kernel, *info->get_psf_info(), data::EventCuts{},
+                   0, n_entries, nullptr, calibration_collection, nullptr);
 
-        pixel_collection->add_event(entry.id_pixel_cs, entry.pixel_energy_cs);
-        hist->fill_photon_energy(entry.photon_energy);
-        hist->fill_histograms(entry.id_pixel, entry.pixel_energy, false);
-        hist->fill_histograms(entry.id_pixel_cs, entry.pixel_energy_cs, true);
+    calibration_collection[0].compute_transition_probabilities();
+    calibration_probabilities = std::make_shared<const solve_system::TransitionProbabilities>(
+        calibration_collection[0].get_transition_probabilities());
+    calibration::save(calibration::STORE_DIRECTORY, info->get_geometry(), binnings[0], calibration_beam_width,
+                      calibration_key(), n_entries, *calibration_probabilities);
+
+    printf("%sINFO - Calibration done.%s\n", INFO_COLOR, END_COLOR);
+}
+
+/**
+ * Function for running the data analysis.
+ */
+void analysis::Analysis::run()
+{
+    options::Options &opt = options::Options::get_instance();
 
-        event->clearEntry(entry);
+    // the calibration pass is skipped only if the same dataset (which fixes the beam width) was already calibrated
+    if (opt.get_calibration_mode()) {
+        calibration_probabilities =
+            calibration::find(calibration::STORE_DIRECTORY, info->get_geometry(), binnings[0], -1, calibration_key());
+        if (!calibration_probabilities) calibrate();
+        else if (opt.get_calibration_file().empty())
+            first_entry = std::min<Long64_t>(opt.get_calibration_entries(), event->get_entries());
+    } else if (opt.get_use_probabilities()) {
+        calibration_probabilities = calibration::find(calibration::STORE_DIRECTORY, info->get_geometry(), binnings[0],
+                                                      info->get_beam_width());
+        if (!calibration_probabilities)
+            printf("%sWARNING - No stored calibration matches, reading %s.%s\n", WARNING_COLOR,
+                   "../output/transition_probabilities.csv", END_COLOR);
     }
 
+    if (options::Options::get_instance().get_batch_mode()) run_batch();
+    else run_interactive();
+
     show_results();
 }
+
+/**
+ * Function for running the event loop
+ * entry by entry, printing each entry and
+ * waiting for the user's input.
+ */
+void analysis::Analysis::run_interactive()
+{
+    std::shared_ptr<const data::PSFInfo> psf_info = info->get_psf_info();
+
+    std::string choice = " ";
+    for (int i = first_entry; i < event->get_entries(); i++) {
+        if (choice == "e") std::exit(0);
+
+        if (choice == "s") break;
+
+        if (i % 10'000 == 0 && i != first_entry) printf("%sINFO - %i entries processed.%s\n", INFO_COLOR, i, END_COLOR);
+
+        if (cuts.enabled() && !event->select(i, cuts, *psf_info)) continue;
+        const data::EventView &entry = event->read(i);
+
+        if (choice == "g") {
+            event_kernel->process(entry, *hist, pixel_collections, pixel_map.get(), cluster_finder.get());
+            continue;
+        }
+
+        (i != 0) ? printf("\033c") : printf("");
+        printf("Entry number = %i\n", i);
+        printf("Event ID = %i\n\n", entry.event_id);
+
+        event_kernel->process(entry, *hist, pixel_collections, pixel_map.get(), cluster_finder.get(), true);
+
+        // CHOICE
+        printf("\nType:\n");
+        printf("- 's' to stop\n");
+        printf("- 'g' to go until the end (no print)\n");
+        printf("- 'e' to exit\n");
+        printf("- anything else to continue\n");
+        std::getline(std::cin, choice);
+    }
+}
+
+/**
+ * Function for creating the reader and the
+ * accumulators of a thread of the parallel
+ * event loop.
+ *
+ * @return The worker.
+ */
+analysis::Worker analysis::Analysis::make_worker() const
+{
+    Worker worker;
+    worker.hist = hist->make_worker_copy();
+    worker.pixel_collections = make_pixel_collections();
+    if (pixel_map) worker.pixel_map = std::make_unique<pixel::PixelMap>(info->get_psf_info(), binnings[0]);
+    worker.cluster_finder = make_cluster_finder();
+    open_events(worker, results_path, event_cache, io_profile);
+
+    return worker;
+}
+
+/**
+ * Function for running the event loop
+ * on all the threads (see `process_blocks()`).
+ */
+void analysis::Analysis::run_batch()
+{
+    Long64_t n_entries = event->get_entries() - first_entry;
+
+    Long64_t n_selected = process_blocks("Batch mode", [this] { return make_worker(); }, *event_kernel,
+                                         *info->get_psf_info(), cuts, first_entry, n_entries, hist.get(),
+                                         pixel_collections, pixel_map.get());
+
+    printf("%sINFO - Batch mode: %lld entries processed.%s\n", INFO_COLOR, n_entries, END_COLOR);
+    if (cuts.enabled()) printf("%sINFO - %lld entries passed the cuts.%s\n", INFO_COLOR, n_selected, END_COLOR);
+}
@@ -0,0 +1,302 @@
+#include "calibration.hh"
+
+#include "constants.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char CALIBRATION_MAGIC[4] = {'C', 'A', 'L', 'B'};
+constexpr std::uint32_t CALIBRATION_VERSION = 4;
+constexpr std::uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+
+static_assert(sizeof(calibration::CalibrationHeader) == 104, "the header of the calibrations must be packed");
+static_assert(sizeof(solve_system::TransitionProbabilities::Cell) == 16,
+              "the cells of the calibrations must be packed");
+
+/**
+ * Function for filling the fields of the header
+ * identifying the geometry, the beam and the binning.
+ *
+ * @param[in] geometry The geometry of the detector.
+ * @param[in] binning The energy binning.
+ * @param[in] beam_width The width of the beam, in pixels.
+ * @return The header, with no events.
+ */
+static calibration::CalibrationHeader make_header(const data::Geometry &geometry, const pixel::Binning &binning,
+                                                  int beam_width)
+{
+    calibration::CalibrationHeader header{};
+    std::memcpy(header.magic, CALIBRATION_MAGIC, sizeof(CALIBRATION_MAGIC));
+    header.version = CALIBRATION_VERSION;
+    header.n_pixel = geometry.n_pixel;
+    header.n_subpixel = geometry.n_subpixel;
+    header.beam_type = geometry.beam_type;
+    header.n_thresholds = binning.n_thresholds;
+    header.beam_width = beam_width;
+    header.pixel_dimensions[0] = geometry.pixel_dimensions[0];
+    header.pixel_dimensions[1] = geometry.pixel_dimensions[1];
+    header.subpixel_dimensions[0] = geometry.subpixel_dimensions[0];
+    header.subpixel_dimensions[1] = geometry.subpixel_dimensions[1];
+    header.min_threshold = binning.min_threshold;
+    header.max_threshold = binning.max_threshold;
+
+    return header;
+}
+
+/**
+ * Function for checking whether two headers describe
+ * the same geometry, beam width and binning.
+ */
+static bool same_key(const calibration::CalibrationHeader &a, const calibration::CalibrationHeader &b)
+{
+    return a.n_pixel == b.n_pixel && a.n_subpixel == b.n_subpixel && a.beam_type == b.beam_type &&
+           a.n_thresholds == b.n_thresholds && a.beam_width == b.beam_width &&
+           a.pixel_dimensions[0] == b.pixel_dimensions[0] && a.pixel_dimensions[1] == b.pixel_dimensions[1] &&
+           a.subpixel_dimensions[0] == b.subpixel_dimensions[0] &&
+           a.subpixel_dimensions[1] == b.subpixel_dimensions[1] && a.min_threshold == b.min_threshold &&
+           a.max_threshold == b.max_threshold;
+}
+
+/**
+ * Function for adding bytes to a FNV-1a hash.
+ *
+ * @param[in] hash The hash of the previous bytes.
+ * @param[in] data The pointer to the bytes.
+ * @param[in] size The number of bytes.
+ * @return The updated hash.
+ */
+static std::uint64_t fnv1a(std::uint64_t hash, const void *data, std::size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+
+    return hash;
+}
+
+/**
+ * Function for computing the name of the file of a calibration
+ * from its key (FNV-1a hash of the header, dataset included).
+ */
+static std::string file_name(const calibration::CalibrationHeader &header)
+{
+    std::uint64_t hash = fnv1a(FNV_OFFSET_BASIS, &header, offsetof(calibration::CalibrationHeader, n_events));
+
+    char name[64];
+    snprintf(name, sizeof(name), "calibration_%016llx.cal", static_cast<unsigned long long>(hash));
+    return name;
+}
+
+/**
+ * The default constructor.
+ *
+ * Maps the calibration file into memory.
+ *
+ * @param[in] path The path of the calibration file.
+ */
+calibration::Calibration::Calibration(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+        if (fd >= 0) close(fd);
+        printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    mapping_size = file_stat.st_size;
+    mapping = (mapping_size >= sizeof(CalibrationHeader))
+                  ? mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0)
+                  : MAP_FAILED;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        printf("%sERROR - %s is not a valid calibration%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    header = static_cast<const CalibrationHeader *>(mapping);
+    if (std::memcmp(header->magic, CALIBRATION_MAGIC, sizeof(CALIBRATION_MAGIC)) ||
+        header->version != CALIBRATION_VERSION ||
+        mapping_size != sizeof(CalibrationHeader) + header->n_cells * sizeof(*cells)) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        printf("%sERROR - %s is not a valid calibration%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    cells = reinterpret_cast<const solve_system::TransitionProbabilities::Cell *>(header + 1);
+}
+
+/**
+ * The destructor.
+ *
+ * Unmaps the calibration file.
+ */
+calibration::Calibration::~Calibration()
+{
+    if (mapping) munmap(mapping, mapping_size);
+}
+
+/**
+ * Function for checking whether the calibration was
+ * computed for a geometry, a binning and a beam width.
+ *
+ * @param[in] geometry The geometry of the detector.
+ * @param[in] binning The energy binning.
+ * @param[in] beam_width The width of the beam, in pixels (negative for any width).
+ */
+bool calibration::Calibration::matches(const data::Geometry &geometry, const pixel::Binning &binning,
+                                       int beam_width) const
+{
+    return same_key(*header, make_header(geometry, binning, (beam_width < 0) ? header->beam_width : beam_width));
+}
+
+/**
+ * Function for returning the transition probabilities.
+ */
+solve_system::TransitionProbabilities calibration::Calibration::get_probabilities() const
+{
+    return {header->n_thresholds, {cells, cells + header->n_cells}};
+}
+
+/**
+ * Function for finding the calibration matching a
+ * geometry, a binning and a beam width among the
+ * files of a directory.
+ *
+ * If more than one matches, the one computed
+ * with the largest number of events is used.
+ *
+ * @param[in] directory The directory of the calibrations.
+ * @param[in] geometry The geometry of the detector.
+ * @param[in] binning The energy binning.
+ * @param[in] beam_width The width of the beam, in pixels (negative for any width).
+ * @param[in] source The key of the dataset of the calibration (0 for any dataset).
+ * @return The transition probabilities (null if no calibration matches).
+ */
+std::shared_ptr<const solve_system::TransitionProbabilities>
+calibration::find(const std::string &directory, const data::Geometry &geometry, const pixel::Binning &binning,
+                  int beam_width, std::uint64_t source)
+{
+    std::error_code error;
+    std::unique_ptr<Calibration> best;
+    std::string best_path;
+    for (const auto &entry : std::filesystem::directory_iterator(directory, error)) {
+        if (entry.path().extension() != ".cal") continue;
+
+        try {
+            auto candidate = std::make_unique<Calibration>(entry.path().string());
+            if (!candidate->matches(geometry, binning, beam_width)) continue;
+            if (source && candidate->get_header().source != source) continue;
+            if (best && candidate->get_header().n_events <= best->get_header().n_events) continue;
+
+            best = std::move(candidate);
+            best_path = entry.path().string();
+        } catch (std::runtime_error &) {
+            continue;
+        }
+    }
+
+    if (!best) return nullptr;
+
+    printf("%sINFO - Using the calibration %s (%lld events).%s\n", INFO_COLOR, best_path.c_str(),
+           static_cast<long long>(best->get_header().n_events), END_COLOR);
+    return std::make_shared<const solve_system::TransitionProbabilities>(best->get_probabilities());
+}
+
+/**
+ * Function for saving a calibration to a directory.
+ *
+ * The name of the file depends only on the geometry, the
+ * beam width, the binning and the dataset, so a calibration replaces the
+ * previous one of the same dataset, which is then stale.
+ *
+ * @param[in] directory The directory of the calibrations.
+ * @param[in] geometry The geometry of the detector.
+ * @param[in] binning The energy binning.
+ * @param[in] beam_width The width of the beam, in pixels.
+ * @param[in] source The key of the dataset of the calibration.
+ * @param[in] n_events The number of events used for the calibration.
+ * @param[in] probabilities The transition probabilities.
+ */
+void calibration::save(const std::string &directory, const data::Geometry &geometry, const pixel::Binning &binning,
+                       int beam_width, std::uint64_t source, std::int64_t n_events,
+                       const solve_system::TransitionProbabilities &probabilities)
+{
+    CalibrationHeader header = make_header(geometry, binning, beam_width);
+    header.source = source;
+    header.n_events = n_events;
+    header.n_cells = probabilities.cells.size();
+
+    std::filesystem::path path = std::filesystem::path(directory) / file_name(header);
+
+    std::string tmp_path = path.string() + ".tmp";
+    std::ofstream file(tmp_path, std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        printf("%sERROR - Impossible to create %s%s\n", ERROR_COLOR, tmp_path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(probabilities.cells.data()),
+               probabilities.cells.size() * sizeof(probabilities.cells[0]));
+    file.close();
+
+    if (!file) {
+        std::filesystem::remove(tmp_path);
+        printf("%sERROR - Impossible to write %s%s\n", ERROR_COLOR, tmp_path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+    std::filesystem::rename(tmp_path, path);
+
+    printf("%sINFO - Saved the calibration %s (%lld events).%s\n", INFO_COLOR, path.c_str(),
+           static_cast<long long>(n_events), END_COLOR);
+}
+
+/**
+ * Function for checking whether two
+ * geometries of the detector are the same.
+ */
+bool calibration::same_geometry(const data::Geometry &a, const data::Geometry &b)
+{
+    pixel::Binning binning{};
+    return same_key(make_header(a, binning, 0), make_header(b, binning, 0));
+}
+
+/**
+ * Function for computing the key of the dataset of a
+ * calibration, i.e. the first entries of a ROOT file.
+ *
+ * The file is identified by its name, its size and its
+ * modification time, so a file replaced by another one
+ * with the same name does not reuse its calibration.
+ *
+ * @param[in] path The path of the ROOT file.
+ * @param[in] n_entries The number of entries used (negative for all of them).
+ * @return The key (never 0).
+ */
+std::uint64_t calibration::source_key(const std::string &path, std::int64_t n_entries)
+{
+    std::error_code error;
+    std::string name = std::filesystem::path(path).filename().string();
+    std::int64_t size = std::filesystem::file_size(path, error);
+    if (error) size = -1;
+    std::int64_t time = std::filesystem::last_write_time(path, error).time_since_epoch().count();
+    if (error) time = -1;
+
+    std::uint64_t hash = fnv1a(FNV_OFFSET_BASIS, name.data(), name.size());
+    hash = fnv1a(hash, &size, sizeof(size));
+    hash = fnv1a(hash, &time, sizeof(time));
+    hash = fnv1a(hash, &n_entries, sizeof(n_entries));
+
+    return (hash) ? hash : 1;
+}
@@ -0,0 +1,133 @@
+#include "clustering.hh"
+
+#include "constants.hh"
+
+#include <stdexcept>
+
+bool clustering::ClusterFinder::verbose = false;
+
+/**
+ * The default constructor.
+ *
+ * @param[in] psf The pointer to the PSFInfo structure, with the neighbours of each pixel.
+ * @param[in] connectivity The pixels adjacent to each pixel: 4 (sides) or 8 (sides and corners).
+ * @param[in] threshold The energy below which the hits are ignored.
+ */
+clustering::ClusterFinder::ClusterFinder(std::shared_ptr<const data::PSFInfo> psf, int connectivity,
+                                         double threshold)
+    : psf_info(psf)
+    , connectivity(connectivity)
+    , threshold(threshold)
+    , grid(psf->pixels.size(), -1)
+{
+    // the neighbours are the T pixels (sides), then the TR ones (corners)
+    if (connectivity != PSF_NEIGHBOURS && connectivity != PSF_PIXELS - 1) {
+        printf("%sERROR - The connectivity of the clusters must be 4 or 8, not %i%s\n", ERROR_COLOR, connectivity,
+               END_COLOR);
+        throw std::runtime_error("");
+    }
+}
+
+/**
+ * Function for finding the root of
+ * the tree of a hit (with path halving).
+ *
+ * @param[in] i The index of the hit.
+ * @return The index of the root.
+ */
+int clustering::ClusterFinder::find_root(int i)
+{
+    while (parent[i] != i) {
+        parent[i] = parent[parent[i]];
+        i = parent[i];
+    }
+
+    return i;
+}
+
+/**
+ * Function for joining the trees of two hits
+ * (the root with the lower index is kept, so
+ * the clusters follow the order of the hits).
+ *
+ * @param[in] i The index of the first hit.
+ * @param[in] j The index of the second hit.
+ */
+void clustering::ClusterFinder::unite(int i, int j)
+{
+    int root_i = find_root(i);
+    int root_j = find_root(j);
+    if (root_i == root_j) return;
+
+    (root_i < root_j) ? parent[root_j] = root_i : parent[root_i] = root_j;
+}
+
+/**
+ * Function for finding the clusters of an event.
+ *
+ * @param[in] ids The IDs of the pixels hit.
+ * @param[in] energies The energies deposited in the pixels.
+ * @return The clusters, valid until the next call.
+ */
+const std::vector<clustering::Cluster> &clustering::ClusterFinder::find(data::Span<Int_t> ids,
+                                                                         data::Span<Double_t> energies)
+{
+    int n_hits = ids.size();
+    parent.resize(n_hits);
+    cluster.assign(n_hits, -1);
+    clusters.clear();
+
+    // place the hits on the grid (hits in the same pixel belong together)
+    for (int i = 0; i < n_hits; i++) {
+        parent[i] = i;
+        if (energies[i] < threshold) continue;
+
+        int &cell = grid[ids[i]];
+        if (cell < 0) cell = i;
+        else unite(cell, i);
+    }
+
+    // join the hits next to each other
+    for (int i = 0; i < n_hits; i++) {
+        if (energies[i] < threshold || grid[ids[i]] != i) continue;
+
+        const auto &neighbours = psf_info->neighbours[ids[i]];
+        for (int k = 0; k < connectivity; k++) {
+            int other = neighbours[k];
+            if (other >= 0 && grid[other] >= 0) unite(i, grid[other]);
+        }
+    }
+
+    // sum the hits of each cluster
+    for (int i = 0; i < n_hits; i++) {
+        if (energies[i] < threshold) continue;
+
+        int root = find_root(i);
+        if (cluster[root] < 0) {
+            cluster[root] = clusters.size();
+            clusters.push_back({0, 0, 0, 0});
+        }
+
+        const data::PixelInfo &pixel = psf_info->pixels[ids[i]];
+        Cluster &c = clusters[cluster[root]];
+        c.energy += energies[i];
+        c.x += energies[i] * pixel.x;
+        c.y += energies[i] * pixel.y;
+        if (grid[ids[i]] == i) c.size++;
+    }
+
+    for (Cluster &c : clusters) {
+        if (c.energy > 0) {
+            c.x /= c.energy;
+            c.y /= c.energy;
+        }
+    }
+
+    // clear the grid for the next event
+    for (int i = 0; i < n_hits; i++)
+        if (grid[ids[i]] == i) grid[ids[i]] = -1;
+
+    if (verbose) printf("%sDEBUG - Found %zu cluster(s).%s\n", DEBUG_COLOR, clusters.size(), END_COLOR);
+
+    return clusters;
+}
@@ -0,0 +1,66 @@
+#include "correlation_matrix.hh"
+
+/**
+ * The default constructor.
+ *
+ * @param[in] n_bins The number of bins per side.
+ */
+pixel::CorrelationMatrix::CorrelationMatrix(int n_bins)
+    : n_bins(n_bins)
+    , dense(n_bins <= DENSE_MAX_BINS)
+{
+    if (dense) counts = CounterArray<std::uint32_t>(static_cast<std::size_t>(n_bins) * n_bins);
+}
+
+/**
+ * Function for adding the counts
+ * of another matrix to this one.
+ *
+ * @param[in] other The matrix with the same number of bins.
+ */
+void pixel::CorrelationMatrix::add(const CorrelationMatrix &other)
+{
+    if (dense) {
+        counts.add(other.counts);
+        return;
+    }
+
+    for (const auto &[k, c] : other.sparse_counts)
+        sparse_counts[k] += c;
+}
+
+/**
+ * Function for setting all the counts to 0.
+ */
+void pixel::CorrelationMatrix::reset()
+{
+    counts.reset();
+    sparse_counts.clear();
+}
+
+/**
+ * The default constructor.
+ *
+ * @param[in] n_bins The number of bins per side.
+ */
+pixel::CoincidenceTensor::CoincidenceTensor(int n_bins)
+    : n_bins(n_bins)
+{
+}
+
+/**
+ * Function for adding the counts
+ * of another tensor to this one.
+ *
+ * @param[in] other The tensor with the same number of bins.
+ */
+void pixel::CoincidenceTensor::add(const CoincidenceTensor &other)
+{
+    for (const auto &[k, c] : other.counts)
+        counts[k] += c;
+}
+
+/**
+ * Function for setting all the counts to 0.
+ */
+void pixel::CoincidenceTensor::reset() { counts.clear(); }
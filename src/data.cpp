@@ -1,21 +1,96 @@
 #include "data.hh"
 
+#include "TBranch.h"
 #include "constants.hh"
+#include "event_cache.hh"
+#include "options.hh"
+#include "psf_stencil.hh"
+
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 bool data::Info::verbose = false;
 bool data::Event::verbose = false;
 
+// size of the TTreeCache of the Event tree
+constexpr Long64_t EVENT_CACHE_SIZE = 64 * 1024 * 1024;
+
+/**
+ * Function for assigning the roles of the
+ * pixels in a PSF of radius `RADIUS` around
+ * pixel 0 (the ones outside the array are skipped).
+ */
+template <int RADIUS> void data::PSFInfo::assign_roles()
+{
+    int x_0 = pixels[id_pixel_0].x;
+    int y_0 = pixels[id_pixel_0].y;
+
+    pixels[id_pixel_0].role = ROLE_0;
+    for (const auto &offset : PSFStencil<RADIUS>::offsets) {
+        int x = x_0 + offset.dx, y = y_0 + offset.dy;
+        if (x < 0 || y < 0 || x >= n_pixel || y >= n_pixel) continue;
+
+        PixelInfo &pixel = pixels[y * n_pixel + x];
+        pixel.role = offset.role;
+        pixel.index = offset.index;
+    }
+}
+
 /**
  * Function for filling the IDs
- * of the 0, T and TR pixels.
+ * of the 0, T and TR pixels, and
+ * the tables with the role, the
+ * coordinates and the neighbours
+ * of each pixel.
+ *
+ * @param[in] n_pixel The number of pixels per side of the array.
+ * @param[in] radius The radius of the PSF (1, 2 or 3).
  */
-void data::PSFInfo::get_ids(int n_pixel)
+void data::PSFInfo::get_ids(int n_pixel, int radius)
 {
+    this->n_pixel = n_pixel;
+    this->radius = radius;
     id_pixel_0 = (n_pixel / 2) * (1 + n_pixel);
     id_pixel_t = {id_pixel_0 - n_pixel, id_pixel_0 - 1, id_pixel_0 + 1, id_pixel_0 + n_pixel};
     id_pixel_tr = {id_pixel_0 - n_pixel - 1, id_pixel_0 - n_pixel + 1, id_pixel_0 + n_pixel - 1,
                    id_pixel_0 + n_pixel + 1};
 
+    // same order as id_pixel_t and id_pixel_tr
+    constexpr std::array<int, PSF_PIXELS - 1> dx = {0, -1, 1, 0, -1, 1, -1, 1};
+    constexpr std::array<int, PSF_PIXELS - 1> dy = {-1, 0, 0, 1, -1, -1, 1, 1};
+
+    pixels.resize(n_pixel * n_pixel);
+    neighbours.resize(n_pixel * n_pixel);
+    for (int id = 0; id < pixels.size(); id++) {
+        int y = id / n_pixel;
+        int x = id - y * n_pixel;
+        bool interior = x > 0 && y > 0 && x < n_pixel - 1 && y < n_pixel - 1;
+        pixels[id] = {ROLE_OUTSIDE, 0, interior, static_cast<std::uint16_t>(x), static_cast<std::uint16_t>(y)};
+
+        for (int k = 0; k < neighbours[id].size(); k++) {
+            int nx = x + dx[k], ny = y + dy[k];
+            bool inside = nx >= 0 && ny >= 0 && nx < n_pixel && ny < n_pixel;
+            neighbours[id][k] = (inside) ? ny * n_pixel + nx : -1;
+        }
+    }
+
+    // the stencils are generated at compile time for each radius
+    switch (radius) {
+    case 1:
+        assign_roles<1>();
+        break;
+    case 2:
+        assign_roles<2>();
+        break;
+    case 3:
+        assign_roles<3>();
+        break;
+    default:
+        printf("%sERROR - The radius of the PSF must be 1, 2 or 3, not %i%s\n", ERROR_COLOR, radius, END_COLOR);
+        throw std::runtime_error("");
+    }
+
     printf("Pixel 0: %i\n", id_pixel_0);
 
     printf("Pixel T: ");
@@ -25,7 +100,7 @@ void data::PSFInfo::get_ids(int n_pixel)
     printf("\nPixel TR: ");
     for (int i : id_pixel_tr)
         printf("%i ", i);
-    printf("\n");
+    printf("\nPSF: %ix%i pixels\n", 2 * radius + 1, 2 * radius + 1);
 }
 
 /**
@@ -69,26 +144,132 @@ data::Info::Info(TTree *info_tree)
 
     printf("%s\nINFO ABOUT THE ALGORITHM\n", BOLD);
     printf("------------------------%s\n", END_COLOR);
-    psf_info.get_ids(n_pixel);
+    psf_info.get_ids(n_pixel, options::Options::get_instance().get_psf_radius());
+}
+
+/**
+ * Function for building the I/O profile
+ * from the current options.
+ *
+ * A reconstruction-only run needs just the charge sharing hits
+ * (and the photon energy if it is cut), while the entries are
+ * printed only in interactive mode.
+ */
+data::IOProfile data::IOProfile::from_options()
+{
+    const options::Options &opt = options::Options::get_instance();
+
+    IOProfile profile;
+    profile.event_id = !opt.get_batch_mode();
+    profile.photon_energy = !opt.get_reconstruction_only() || EventCuts::from_options().on_photon_energy();
+    profile.no_charge_sharing = !opt.get_reconstruction_only();
+
+    return profile;
+}
+
+/**
+ * Function for building the cuts
+ * from the current options.
+ */
+data::EventCuts data::EventCuts::from_options()
+{
+    const options::Options &opt = options::Options::get_instance();
+
+    EventCuts cuts;
+    cuts.min_photon_energy = opt.get_min_photon_energy();
+    cuts.max_photon_energy = opt.get_max_photon_energy();
+    cuts.min_hits = opt.get_min_hits();
+    cuts.max_hits = opt.get_max_hits();
+    cuts.psf_hit = opt.get_psf_hit();
+
+    return cuts;
+}
+
+/**
+ * Function for checking whether the charge
+ * sharing hits of an event pass the cuts.
+ *
+ * @param[in] ids The IDs of the pixels hit.
+ * @param[in] psf The PSFInfo structure, with the role of each pixel.
+ */
+bool data::EventCuts::pass_hits(Span<Int_t> ids, const PSFInfo &psf) const
+{
+    int n_hits = ids.size();
+    if (n_hits < min_hits || (max_hits >= 0 && n_hits > max_hits)) return false;
+    if (!psf_hit) return true;
+
+    for (Int_t id : ids)
+        if (psf.pixels[id].role != ROLE_OUTSIDE) return true;
+
+    return false;
 }
 
 /**
  * The default constructor.
  *
- * Loads the results of the simulation.
+ * Loads the results of the simulation, enabling only the branches
+ * in the I/O profile and adding them to the TTreeCache, so that
+ * the baskets of the other branches are never read nor decompressed.
  *
  * @param[in] hits_tree The pointer to the TTree where the results of the simulation are stored.
+ * @param[in] profile The branches needed by the enabled stages.
  */
-data::Event::Event(TTree *hits_tree)
+data::Event::Event(TTree *hits_tree, const IOProfile &profile)
+    : tree(hits_tree)
 {
-    hits_tree->SetBranchAddress("Event_ID", &event_id);
-    hits_tree->SetBranchAddress("Photon_energy", &photon_energy);
-    hits_tree->SetBranchAddress("ID_Merge_NOCS", &id_pixel);
-    hits_tree->SetBranchAddress("Energy_Merge_NOCS", &pixel_energy);
+    std::vector<const char *> branches{"ID_Merge", "Energy_Merge"};
+    if (profile.event_id) branches.push_back("Event_ID");
+    if (profile.photon_energy) branches.push_back("Photon_energy");
+    if (profile.no_charge_sharing) {
+        branches.push_back("ID_Merge_NOCS");
+        branches.push_back("Energy_Merge_NOCS");
+    }
+
+    hits_tree->SetBranchStatus("*", false);
+    for (const char *branch : branches)
+        hits_tree->SetBranchStatus(branch, true);
+
     hits_tree->SetBranchAddress("ID_Merge", &id_pixel_cs);
     hits_tree->SetBranchAddress("Energy_Merge", &pixel_energy_cs);
+    if (profile.event_id) hits_tree->SetBranchAddress("Event_ID", &event_id);
+    if (profile.photon_energy) hits_tree->SetBranchAddress("Photon_energy", &photon_energy);
+    if (profile.no_charge_sharing) {
+        hits_tree->SetBranchAddress("ID_Merge_NOCS", &id_pixel);
+        hits_tree->SetBranchAddress("Energy_Merge_NOCS", &pixel_energy);
+    }
 
-    printf("\n%sINFO - Loaded hits info from tree.%s\n", INFO_COLOR, END_COLOR);
+    // the photon energy and the IDs can be read alone to select the entry
+    for (const char *branch : branches) {
+        TBranch *b = hits_tree->GetBranch(branch);
+        if (!b) continue;
+
+        if (std::string(branch) == "Photon_energy") photon_energy_branch = b;
+        else if (std::string(branch) == "ID_Merge") id_pixel_cs_branch = b;
+        else other_branches.push_back(b);
+    }
+
+    // the branches are known in advance, so the cache does not need to learn them
+    hits_tree->SetCacheSize(EVENT_CACHE_SIZE);
+    Long64_t read_bytes = 0;
+    for (const char *branch : branches) {
+        hits_tree->AddBranchToCache(branch, true);
+        if (TBranch *b = hits_tree->GetBranch(branch)) read_bytes += b->GetZipBytes();
+    }
+    hits_tree->StopCacheLearningPhase();
+
+    printf("\n%sINFO - Loaded hits info from tree (%zu branches, %.1f MB compressed).%s\n", INFO_COLOR,
+           branches.size(), read_bytes / (1024. * 1024.), END_COLOR);
+}
+
+/**
+ * Constructor reading the events
+ * from the memory-mapped event cache.
+ *
+ * @param[in] event_cache The pointer to the event cache.
+ */
+data::Event::Event(std::shared_ptr<const EventCache> event_cache)
+    : cache(event_cache)
+{
 }
 
 /**
@@ -98,28 +279,103 @@ data::Event::Event(TTree *hits_tree)
  */
 data::Event::~Event()
 {
-    id_pixel->clear();
-    pixel_energy->clear();
-    id_pixel_cs->clear();
-    pixel_energy_cs->clear();
+    // the vectors are allocated by ROOT when the first entry is read
+    if (id_pixel) id_pixel->clear();
+    if (pixel_energy) pixel_energy->clear();
+    if (id_pixel_cs) id_pixel_cs->clear();
+    if (pixel_energy_cs) pixel_energy_cs->clear();
+}
+
+/**
+ * Function for returning the number of events.
+ */
+Long64_t data::Event::get_entries() const { return cache ? cache->get_entries() : tree->GetEntries(); }
+
+/**
+ * Function for restricting the TTreeCache to the
+ * entries about to be read (nothing to do with the event cache).
+ *
+ * @param[in] first The first entry.
+ * @param[in] last The entry after the last one.
+ */
+void data::Event::set_entry_range(Long64_t first, Long64_t last)
+{
+    if (tree) tree->SetCacheEntryRange(first, last);
 }
 
 /**
- * Function for returning an entry of the TTree "Event".
+ * Function for checking whether an entry passes the cuts,
+ * reading only the branches needed by them: first the
+ * photon energy, then the IDs of the charge sharing hits.
+ * The other branches are read by `read()` only if it passes.
+ *
+ * The tree is moved to the entry first, so the TTreeCache
+ * follows it and the branches get the local entry number.
+ *
+ * @param[in] entry The number of the entry.
+ * @param[in] cuts The cuts.
+ * @param[in] psf The PSFInfo structure, with the role of each pixel.
+ * @return Whether the entry passes the cuts.
  */
-data::Entry data::Event::get_entry() const
+bool data::Event::select(Long64_t entry, const EventCuts &cuts, const PSFInfo &psf)
 {
-    return {event_id, photon_energy, *id_pixel, *pixel_energy, *id_pixel_cs, *pixel_energy_cs};
+    if (cache) {
+        const EventView &view = cache->get_view(entry);
+        return (!cuts.on_photon_energy() || cuts.pass_photon_energy(view.photon_energy)) &&
+               (!cuts.on_hits() || cuts.pass_hits(view.id_pixel_cs, psf));
+    }
+
+    selected_entry = entry;
+    selected_local_entry = tree->LoadTree(entry);
+    photon_energy_read = cuts.on_photon_energy() && photon_energy_branch;
+    id_pixel_cs_read = false;
+    if (selected_local_entry < 0) {
+        selected_entry = -1;
+        return false;
+    }
+
+    if (photon_energy_read) {
+        photon_energy_branch->GetEntry(selected_local_entry);
+        if (!cuts.pass_photon_energy(photon_energy)) return false;
+    }
+
+    if (cuts.on_hits() && id_pixel_cs_branch) {
+        id_pixel_cs_branch->GetEntry(selected_local_entry);
+        id_pixel_cs_read = true;
+        if (!cuts.pass_hits(*id_pixel_cs, psf)) return false;
+    }
+
+    return true;
 }
 
 /**
- * Function for clearing the previous row, before
- * loading a new one.
+ * Function for reading an entry of the TTree
+ * "Event" and returning a view of it, without copying it.
+ *
+ * After `select()`, only the branches not
+ * read yet are read for the same entry.
+ *
+ * @param[in] entry The number of the entry.
  */
-void data::Event::clearEntry(Entry &entry) const
+data::EventView data::Event::read(Long64_t entry)
 {
-    entry.id_pixel.clear();
-    entry.id_pixel_cs.clear();
-    entry.pixel_energy.clear();
-    entry.pixel_energy_cs.clear();
+    if (cache) return cache->get_view(entry);
+
+    if (entry == selected_entry) {
+        Long64_t local = selected_local_entry;
+        if (photon_energy_branch && !photon_energy_read) photon_energy_branch->GetEntry(local);
+        if (id_pixel_cs_branch && !id_pixel_cs_read) id_pixel_cs_branch->GetEntry(local);
+        for (TBranch *branch : other_branches)
+            branch->GetEntry(local);
+        selected_entry = -1;
+    } else {
+        tree->GetEntry(entry);
+    }
+
+    // branches outside the I/O profile are never bound, so their views are empty
+    EventView view{event_id, photon_energy, {}, {}, *id_pixel_cs, *pixel_energy_cs};
+    if (id_pixel) view.id_pixel = *id_pixel;
+    if (pixel_energy) view.pixel_energy = *pixel_energy;
+
+    return view;
 }
@@ -0,0 +1,170 @@
+#include "dump_writer.hh"
+
+#include "constants.hh"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+constexpr char DUMP_MAGIC[4] = {'E', 'D', 'M', 'P'};
+constexpr std::uint32_t DUMP_VERSION = 1;
+constexpr std::size_t DUMP_HEADER_SIZE = 16;
+// # of blocks waiting to be written before the event loop waits
+constexpr std::size_t MAX_QUEUED_BLOCKS = 16;
+
+/**
+ * The default constructor.
+ *
+ * It opens the file, writes a provisional header
+ * and starts the writer thread.
+ *
+ * @param[in] path The path of the binary file.
+ */
+graphs::DumpWriter::DumpWriter(const std::string &path)
+{
+    file.open(path, std::ios::out | std::ios::binary);
+    if (!file.is_open()) throw std::runtime_error("Impossible to open dump file " + path + ".");
+
+    std::array<char, DUMP_HEADER_SIZE> header{};
+    file.write(header.data(), header.size());
+
+    thread = std::thread(&DumpWriter::write_loop, this);
+}
+
+/**
+ * The destructor.
+ *
+ * It closes the file if `close()` was not called
+ * (the write errors are then not reported).
+ */
+graphs::DumpWriter::~DumpWriter() { close(); }
+
+/**
+ * Function for closing the file: it waits for the
+ * queued blocks to be written, stops the writer
+ * thread and completes the header.
+ *
+ * @return Whether all the values and the header were written.
+ */
+bool graphs::DumpWriter::close()
+{
+    if (!thread.joinable()) return !failed;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        done = true;
+    }
+    condition.notify_all();
+    thread.join();
+
+    std::array<char, DUMP_HEADER_SIZE> header{};
+    std::memcpy(header.data(), DUMP_MAGIC, sizeof(DUMP_MAGIC));
+    std::memcpy(header.data() + 4, &DUMP_VERSION, sizeof(DUMP_VERSION));
+    std::memcpy(header.data() + 8, &n_values, sizeof(n_values));
+
+    file.seekp(0);
+    file.write(header.data(), header.size());
+    file.close();
+    if (!file) failed = true;
+
+    return !failed;
+}
+
+/**
+ * Function run by the writer thread: it writes
+ * the queued blocks until the writer is closed.
+ *
+ * After a failed write the blocks are still taken
+ * from the queue, so the event loop is never blocked,
+ * but they are dropped.
+ */
+void graphs::DumpWriter::write_loop()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        condition.wait(lock, [this] { return done || !queue.empty(); });
+        if (queue.empty()) break;
+
+        std::vector<float> block = std::move(queue.front());
+        queue.pop_front();
+        condition.notify_all();
+
+        bool write = !failed;
+        lock.unlock();
+        if (write) {
+            file.write(reinterpret_cast<const char *>(block.data()), block.size() * sizeof(float));
+            n_values += block.size();
+        }
+        block.clear();
+        lock.lock();
+
+        if (write && !file) failed = true;
+
+        free_blocks.push_back(std::move(block));
+    }
+}
+
+/**
+ * Function for handing a block of values
+ * to the writer thread.
+ *
+ * The block is replaced by an empty buffer, recycled
+ * from the blocks already written when possible.
+ *
+ * @param[in] block The values to write.
+ */
+void graphs::DumpWriter::submit(std::vector<float> &block)
+{
+    if (block.empty()) return;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    condition.wait(lock, [this] { return queue.size() < MAX_QUEUED_BLOCKS; });
+
+    queue.push_back(std::move(block));
+    if (!free_blocks.empty()) {
+        block = std::move(free_blocks.back());
+        free_blocks.pop_back();
+    } else {
+        block = std::vector<float>();
+        block.reserve(DUMP_BLOCK_SIZE);
+    }
+
+    lock.unlock();
+    condition.notify_all();
+}
+
+/**
+ * Function for converting a binary dump
+ * into a text file with one value per line.
+ *
+ * @param[in] binary_path The path of the binary file.
+ * @param[in] text_path The path of the text file.
+ */
+void graphs::DumpWriter::export_text(const std::string &binary_path, const std::string &text_path)
+{
+    std::ifstream binary_file(binary_path, std::ios::in | std::ios::binary);
+    if (!binary_file.is_open()) throw std::runtime_error("Impossible to open dump file " + binary_path + ".");
+
+    std::array<char, DUMP_HEADER_SIZE> header{};
+    binary_file.read(header.data(), header.size());
+    if (std::memcmp(header.data(), DUMP_MAGIC, sizeof(DUMP_MAGIC)))
+        throw std::runtime_error(binary_path + " is not a dump file.");
+
+    std::uint64_t n_values;
+    std::memcpy(&n_values, header.data() + 8, sizeof(n_values));
+
+    std::ofstream text_file(text_path, std::ios::out);
+    if (!text_file.is_open()) throw std::runtime_error("Impossible to open " + text_path + ".");
+
+    std::vector<float> block(DUMP_BLOCK_SIZE);
+    for (std::uint64_t first = 0; first < n_values; first += block.size()) {
+        std::size_t n = std::min<std::uint64_t>(block.size(), n_values - first);
+        binary_file.read(reinterpret_cast<char *>(block.data()), n * sizeof(float));
+
+        for (std::size_t i = 0; i < n; i++)
+            text_file << block[i] << "\n";
+    }
+
+    printf("%sINFO - Exported %s to %s.%s\n", INFO_COLOR, binary_path.c_str(), text_path.c_str(), END_COLOR);
+}
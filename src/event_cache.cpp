@@ -0,0 +1,275 @@
+#include "event_cache.hh"
+
+#include "constants.hh"
+
+#include <array>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+constexpr char CACHE_MAGIC[4] = {'E', 'V', 'C', 'S'};
+constexpr std::uint32_t CACHE_VERSION = 1;
+
+static_assert(sizeof(data::EventCacheHeader) == 48, "the header of the event cache must be packed");
+
+/**
+ * Function for computing the size of the
+ * cache file described by a header.
+ *
+ * @param[in] header The header of the file.
+ * @return The size in bytes.
+ */
+static std::size_t cache_size(const data::EventCacheHeader &header)
+{
+    std::size_t n_events = header.n_events;
+    std::size_t n_hits = header.n_hits + header.n_hits_cs;
+
+    return sizeof(header) + n_events * sizeof(Double_t) + 2 * (n_events + 1) * sizeof(std::uint64_t) +
+           n_hits * sizeof(Double_t) + n_events * sizeof(Int_t) + n_hits * sizeof(Int_t);
+}
+
+/**
+ * Function for filling the fields of the
+ * header identifying the ROOT file.
+ *
+ * @param[in] source_path The path of the ROOT file.
+ * @param[out] header The header.
+ */
+static void set_source(const std::string &source_path, data::EventCacheHeader &header)
+{
+    header.source_size = std::filesystem::file_size(source_path);
+    header.source_time = std::filesystem::last_write_time(source_path).time_since_epoch().count();
+}
+
+/**
+ * The default constructor.
+ *
+ * Maps the cache file into memory and
+ * sets the pointers to the columns.
+ *
+ * @param[in] path The path of the cache file.
+ */
+data::EventCache::EventCache(const std::string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat file_stat;
+    if (fd < 0 || fstat(fd, &file_stat) < 0) {
+        if (fd >= 0) close(fd);
+        printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    mapping_size = file_stat.st_size;
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED || mapping_size < sizeof(EventCacheHeader)) {
+        if (mapping != MAP_FAILED) munmap(mapping, mapping_size);
+        mapping = nullptr;
+        printf("%sERROR - Impossible to map %s%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+
+    header = static_cast<const EventCacheHeader *>(mapping);
+    if (std::memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) || header->version != CACHE_VERSION ||
+        cache_size(*header) != mapping_size) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        printf("%sERROR - %s is not a valid event cache%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    std::size_t n_events = header->n_events;
+    const char *column = static_cast<const char *>(mapping) + sizeof(EventCacheHeader);
+    auto next_column = [&column](auto &pointer, std::size_t size) {
+        pointer = reinterpret_cast<std::remove_reference_t<decltype(pointer)>>(column);
+        column += size * sizeof(*pointer);
+    };
+    next_column(photon_energy, n_events);
+    next_column(offsets, n_events + 1);
+    next_column(offsets_cs, n_events + 1);
+    next_column(pixel_energy, header->n_hits);
+    next_column(pixel_energy_cs, header->n_hits_cs);
+    next_column(event_id, n_events);
+    next_column(id_pixel, header->n_hits);
+    next_column(id_pixel_cs, header->n_hits_cs);
+
+    printf("\n%sINFO - Loaded hits info from event cache %s.%s\n", INFO_COLOR, path.c_str(), END_COLOR);
+}
+
+/**
+ * The destructor.
+ *
+ * Unmaps the cache file.
+ */
+data::EventCache::~EventCache()
+{
+    if (mapping) munmap(mapping, mapping_size);
+}
+
+/**
+ * Function for returning a view of
+ * an event, without copying it.
+ *
+ * @param[in] entry The number of the event.
+ */
+data::EventView data::EventCache::get_view(Long64_t entry) const
+{
+    std::uint64_t first = offsets[entry], last = offsets[entry + 1];
+    std::uint64_t first_cs = offsets_cs[entry], last_cs = offsets_cs[entry + 1];
+
+    return {event_id[entry],
+            photon_energy[entry],
+            {id_pixel + first, last - first},
+            {pixel_energy + first, last - first},
+            {id_pixel_cs + first_cs, last_cs - first_cs},
+            {pixel_energy_cs + first_cs, last_cs - first_cs}};
+}
+
+/**
+ * Function for checking whether a cache file
+ * exists and was built from the current ROOT file.
+ *
+ * @param[in] path The path of the cache file.
+ * @param[in] source_path The path of the ROOT file.
+ */
+bool data::EventCache::is_valid(const std::string &path, const std::string &source_path)
+{
+    std::ifstream file(path, std::ios::binary);
+    EventCacheHeader header{}, source{};
+    if (!file.read(reinterpret_cast<char *>(&header), sizeof(header))) return false;
+    set_source(source_path, source);
+
+    return !std::memcmp(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) && header.version == CACHE_VERSION &&
+           header.source_size == source.source_size && header.source_time == source.source_time &&
+           cache_size(header) == std::filesystem::file_size(path);
+}
+
+/**
+ * Function for converting the Event TTree into
+ * a cache file, reading all the branches once.
+ *
+ * Each column is streamed to its own temporary file while the
+ * tree is read, so the memory used does not grow with the number
+ * of events, and the columns are then appended after the header.
+ * The file is written under a temporary name and then renamed,
+ * so an interrupted conversion leaves no cache.
+ *
+ * @param[in] hits_tree The pointer to the TTree where the results of the simulation are stored.
+ * @param[in] path The path of the cache file.
+ * @param[in] source_path The path of the ROOT file.
+ */
+void data::EventCache::build(TTree *hits_tree, const std::string &path, const std::string &source_path)
+{
+    printf("%sINFO - Converting the Event tree into the event cache %s.%s\n", INFO_COLOR, path.c_str(), END_COLOR);
+
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path());
+
+    // in the order of the file
+    enum Column {
+        PHOTON_ENERGY,
+        OFFSETS,
+        OFFSETS_CS,
+        PIXEL_ENERGY,
+        PIXEL_ENERGY_CS,
+        EVENT_ID,
+        ID_PIXEL,
+        ID_PIXEL_CS,
+        N_COLUMNS
+    };
+    std::array<std::string, N_COLUMNS> column_paths;
+    std::array<std::ofstream, N_COLUMNS> columns;
+    auto remove_columns = [&column_paths] {
+        std::error_code error;
+        for (const std::string &column_path : column_paths)
+            std::filesystem::remove(column_path, error);
+    };
+
+    for (int c = 0; c < N_COLUMNS; c++) {
+        column_paths[c] = path + ".column" + std::to_string(c) + ".tmp";
+        columns[c].open(column_paths[c], std::ios::out | std::ios::binary);
+        if (!columns[c].is_open()) {
+            remove_columns();
+            printf("%sERROR - Impossible to create %s%s\n", ERROR_COLOR, column_paths[c].c_str(), END_COLOR);
+            throw std::runtime_error("");
+        }
+    }
+
+    auto write_values = [&columns](int column, const auto *values, std::size_t n) {
+        columns[column].write(reinterpret_cast<const char *>(values), n * sizeof(*values));
+    };
+
+    EventCacheHeader header{};
+    std::uint64_t offset = 0, offset_cs = 0;
+    write_values(OFFSETS, &offset, 1);
+    write_values(OFFSETS_CS, &offset_cs, 1);
+    {
+        Event event(hits_tree, IOProfile{});
+        Long64_t n_entries = event.get_entries();
+        for (Long64_t i = 0; i < n_entries; i++) {
+            EventView view = event.read(i);
+
+            write_values(EVENT_ID, &view.event_id, 1);
+            write_values(PHOTON_ENERGY, &view.photon_energy, 1);
+            write_values(ID_PIXEL, view.id_pixel.data(), view.id_pixel.size());
+            write_values(PIXEL_ENERGY, view.pixel_energy.data(), view.pixel_energy.size());
+            write_values(ID_PIXEL_CS, view.id_pixel_cs.data(), view.id_pixel_cs.size());
+            write_values(PIXEL_ENERGY_CS, view.pixel_energy_cs.data(), view.pixel_energy_cs.size());
+
+            offset += view.id_pixel.size();
+            offset_cs += view.id_pixel_cs.size();
+            write_values(OFFSETS, &offset, 1);
+            write_values(OFFSETS_CS, &offset_cs, 1);
+        }
+        header.n_events = n_entries;
+    }
+    // the branch addresses pointed to the buffers of the local Event
+    hits_tree->ResetBranchAddresses();
+
+    std::memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.n_hits = offset;
+    header.n_hits_cs = offset_cs;
+    set_source(source_path, header);
+
+    bool written = true;
+    for (std::ofstream &column : columns) {
+        column.close();
+        written = written && column;
+    }
+
+    std::string tmp_path = path + ".tmp";
+    std::ofstream file(tmp_path, std::ios::out | std::ios::binary);
+    if (!file.is_open()) {
+        remove_columns();
+        printf("%sERROR - Impossible to create %s%s\n", ERROR_COLOR, tmp_path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    for (const std::string &column_path : column_paths) {
+        // an empty column would set the failbit of the file
+        std::ifstream column(column_path, std::ios::in | std::ios::binary);
+        if (written && std::filesystem::file_size(column_path)) file << column.rdbuf();
+    }
+    file.close();
+    remove_columns();
+
+    if (!written || !file || std::filesystem::file_size(tmp_path) != cache_size(header)) {
+        std::filesystem::remove(tmp_path);
+        printf("%sERROR - Impossible to write %s%s\n", ERROR_COLOR, tmp_path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+    std::filesystem::rename(tmp_path, path);
+
+    printf("%sINFO - Event cache written (%llu events, %llu + %llu hits).%s\n", INFO_COLOR,
+           static_cast<unsigned long long>(header.n_events), static_cast<unsigned long long>(header.n_hits),
+           static_cast<unsigned long long>(header.n_hits_cs), END_COLOR);
+}
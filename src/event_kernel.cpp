@@ -0,0 +1,120 @@
+#include "event_kernel.hh"
+
+#include "constants.hh"
+#include "reference.hh"
+
+bool kernel::EventKernel::verbose = false;
+
+/**
+ * The default constructor.
+ *
+ * @param[in] n_pixel The number of pixels per side of the array.
+ * @param[in] psf The pointer to the PSFInfo structure.
+ * @param[in] profile The branches read from the Event tree.
+ */
+kernel::EventKernel::EventKernel(int n_pixel, std::shared_ptr<data::PSFInfo> psf, const data::IOProfile &profile)
+    : n_pixel(n_pixel)
+    , psf_info(psf)
+    , profile(profile)
+{
+}
+
+/**
+ * Function for processing an event.
+ *
+ * @param[in] event The view of the event.
+ * @param[in] hist The histograms to fill.
+ * @param[in] pixels The pixel collections to fill, one for each binning.
+ * @param[in] pixel_map The spectra of all the pixels to fill (if not null).
+ * @param[in] cluster_finder The clustering of the hits with charge sharing (if not null).
+ * @param[in] print Whether to print the event to the terminal.
+ */
+void kernel::EventKernel::process(const data::EventView &event, graphs::Histograms &hist,
+                                  std::vector<pixel::PixelCollection> &pixels, pixel::PixelMap *pixel_map,
+                                  clustering::ClusterFinder *cluster_finder, bool print) const
+{
+    const data::PSFInfo &psf = *psf_info;
+
+    // no charge sharing
+    if (profile.no_charge_sharing) {
+        if (print) {
+            printf("%sNO CHARGE SHARING%s\n", BOLD, END_COLOR);
+            printf("-----------------\n");
+        }
+
+        hist.fill_spectrum(event.pixel_energy, false);
+
+        double total_energy = 0;
+        for (int i = 0; i < event.id_pixel.size(); i++) {
+            int id = event.id_pixel[i];
+            double energy = event.pixel_energy[i];
+
+            hist.fill_hit(psf.get_pixel(id), energy, false);
+            total_energy += energy;
+
+            if (print) printf("ID = %i; Energy = %f GeV\n", id, energy);
+        }
+        hist.fill_total_energy(total_energy, false);
+        if (print) printf("Total energy = %f GeV\n", total_energy);
+    }
+
+    // with charge sharing
+    if (print) {
+        printf("\n%sWITH CHARGE SHARING%s\n", BOLD, END_COLOR);
+        printf("-------------------\n");
+    }
+
+    for (pixel::PixelCollection &pixel_collection : pixels)
+        pixel_collection.begin_event();
+
+    hist.fill_spectrum(event.pixel_energy_cs, true);
+
+    double total_energy_cs = 0;
+    double energy_0 = 0;
+    double energy_neighbours = 0;
+    int i_max = 0;
+    for (int i = 0; i < event.id_pixel_cs.size(); i++) {
+        int id = event.id_pixel_cs[i];
+        double energy = event.pixel_energy_cs[i];
+
+        const data::PixelInfo &pixel = psf.get_pixel(id);
+
+        hist.fill_hit(pixel, energy, true);
+        total_energy_cs += energy;
+        if (energy > event.pixel_energy_cs[i_max]) i_max = i;
+
+        // the reference algorithm merges only the 3x3 pixels (0, T and TR)
+        if (pixel.role < MAX_PSF_ELEMENTS) {
+            hist.fill_psf_histograms(pixel.role, energy);
+            (pixel.role == data::ROLE_0) ? energy_0 += energy : energy_neighbours += energy;
+        }
+
+        if (print) printf("ID = %i; Energy = %f GeV\n", id, energy);
+    }
+    hist.fill_total_energy(total_energy_cs, true);
+    if (print) printf("Total energy = %f GeV\n", total_energy_cs);
+
+    // the energies of the event are binned at once by each collection
+    for (pixel::PixelCollection &pixel_collection : pixels) {
+        pixel_collection.fill_hits(event.id_pixel_cs, event.pixel_energy_cs);
+        pixel_collection.end_event();
+    }
+    // the pixel map has the binning of the first collection
+    if (pixel_map) {
+        pixel_map->fill_hits(event.id_pixel_cs, pixels[0].get_hit_bins());
+        pixel_map->end_event();
+    }
+
+    if (cluster_finder) hist.fill_clusters(cluster_finder->find(event.id_pixel_cs, event.pixel_energy_cs));
+
+    // reference algorithm (needs the hits without charge sharing)
+    if (profile.no_charge_sharing && event.id_pixel.size() && event.id_pixel_cs.size()) {
+        int role_max = psf.get_pixel(event.id_pixel_cs[i_max]).role;
+        hist.fill_reference(reference_algorithm::clustered_energy_0(role_max, energy_0, energy_neighbours));
+    }
+
+    if (profile.photon_energy) hist.fill_photon_energy(event.photon_energy);
+
+    if (verbose && profile.event_id)
+        printf("%sDEBUG - Processed event %i.%s\n", DEBUG_COLOR, event.event_id, END_COLOR);
+}
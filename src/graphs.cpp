@@ -1,6 +1,7 @@
 #include "graphs.hh"
 
 #include "TApplication.h"
+#include "TFile.h"
 #include "TRootCanvas.h"
 #include "constants.hh"
 #include "options.hh"
@@ -19,12 +20,17 @@ bool graphs::Histograms::verbose = false;
  *
  * @param[in] n_pixel The number of pixels per side of the array.
  * @param[in] psf The pointer to the PSFInfo structure.
+ * @param[in] binning The energy binning of the spectra of the pixels.
  */
-graphs::Histograms::Histograms(int n_pixel, std::shared_ptr<data::PSFInfo> psf)
-    : psf_info(psf)
+graphs::Histograms::Histograms(int n_pixel, std::shared_ptr<data::PSFInfo> psf, const pixel::Binning &binning)
+    : binning(binning)
+    , psf_info(psf)
 {
     using namespace options;
 
+    // the histograms are owned by this class, not by the open file
+    TH1::AddDirectory(false);
+
     hist_energy_spectrum = new TH1D("TH1D energy spectrum", "Energy spectrum (no charge sharing)", 100, 0, 0.1);
     hist_energy_spectrum_cs = new TH1D("TH1D energy spectrum CS", "Energy spectrum (with charge sharing)", 100, 0, 0.1);
 
@@ -36,52 +42,101 @@ graphs::Histograms::Histograms(int n_pixel, std::shared_ptr<data::PSFInfo> psf)
     hist_energy_pixels_cs = new TH2D("TH2D pixel energy CS", "Energy per pixel (with charge sharing)", n_pixel, -0.5,
                                      n_pixel - 0.5, n_pixel, -0.5, n_pixel - 0.5);
 
-    int N = Options::get_instance().get_n_thresholds();
-
-    hist_energy_central = new TH1D("TH1D central pixel energy", "Energy in the central pixel", N, 0,
-                                   Options::get_instance().get_max_threshold());
-    hist_energy_t =
-        new TH1D("TH1D T pixels energy", "Energy in the T pixels", N, 0, Options::get_instance().get_max_threshold());
-    hist_energy_tr =
-        new TH1D("TH1D TR pixels energy", "Energy in the TR pixels", N, 0, Options::get_instance().get_max_threshold());
-
-    hist_photon_energy = new TH1D("TH1D photon energy", "Original spectrum of the photon", 50, 0,
-                                  Options::get_instance().get_max_threshold());
-    hist_energy_central_corrected =
-        new TH1D("TH1D reconstructed central pixel energy", "Energy in the central pixel (after reconstruction)", N, 0,
-                 Options::get_instance().get_max_threshold());
-    hist_energy_central_corrected_reference = new TH1D("TH1D reconstructed central pixel energy (reference)",
-                                                       "Energy in the central pixel (after reference algorithm)", N, 0,
-                                                       Options::get_instance().get_max_threshold());
+    int N = binning.n_thresholds;
+    double min_thr = binning.min_threshold;
+    double max_thr = binning.max_threshold;
+
+    hist_energy_central = new TH1D("TH1D central pixel energy", "Energy in the central pixel", N, min_thr, max_thr);
+    hist_energy_t = new TH1D("TH1D T pixels energy", "Energy in the T pixels", N, min_thr, max_thr);
+    hist_energy_tr = new TH1D("TH1D TR pixels energy", "Energy in the TR pixels", N, min_thr, max_thr);
+
+    hist_photon_energy = new TH1D("TH1D photon energy", "Original spectrum of the photon", 50, 0, max_thr);
+    hist_energy_central_corrected = new TH1D("TH1D reconstructed central pixel energy",
+                                             "Energy in the central pixel (after reconstruction)", N, min_thr, max_thr);
+    hist_energy_central_corrected_reference =
+        new TH1D("TH1D reconstructed central pixel energy (reference)",
+                 "Energy in the central pixel (after reference algorithm)", N, min_thr, max_thr);
     hist_stack_corrections = new THStack("THStack central pixel corrections", "Energy before and after reconstruction");
     hist_stack_corrections_reference =
         new THStack("THStack central pixel corrections", "Energy before and after reconstruction (reference)");
 
+    hist_cluster_energy = new TH1D("TH1D cluster energy", "Energy of the clusters", 100, 0, 0.1);
+    hist_cluster_size = new TH1D("TH1D cluster size", "Pixels per cluster", 20, 0.5, 20.5);
+    hist_cluster_multiplicity = new TH1D("TH1D cluster multiplicity", "Clusters per event", 10, -0.5, 9.5);
+    hist_cluster_centroids = new TH2D("TH2D cluster centroids", "Centroids of the clusters", n_pixel, -0.5,
+                                      n_pixel - 0.5, n_pixel, -0.5, n_pixel - 0.5);
+
+    energy_spectrum = Hist1D(100, 0, 0.1);
+    energy_spectrum_cs = Hist1D(100, 0, 0.1);
+    total_energy = Hist1D(100, 0, 0.1);
+    total_energy_cs = Hist1D(100, 0, 0.1);
+    energy_pixels = Hist2D(n_pixel, -0.5, n_pixel - 0.5, n_pixel, -0.5, n_pixel - 0.5);
+    energy_pixels_cs = Hist2D(n_pixel, -0.5, n_pixel - 0.5, n_pixel, -0.5, n_pixel - 0.5);
+    energy_central = Hist1D(N, min_thr, max_thr);
+    energy_t = Hist1D(N, min_thr, max_thr);
+    energy_tr = Hist1D(N, min_thr, max_thr);
+    photon_energy = Hist1D(50, 0, max_thr);
+    energy_central_corrected_reference = Hist1D(N, min_thr, max_thr);
+    cluster_energy = Hist1D(100, 0, 0.1);
+    cluster_size = Hist1D(20, 0.5, 20.5);
+    cluster_multiplicity = Hist1D(10, -0.5, 9.5);
+    cluster_centroids = Hist2D(n_pixel, -0.5, n_pixel - 0.5, n_pixel, -0.5, n_pixel - 0.5);
+
     printf("%sINFO - Histograms created.%s\n\n", INFO_COLOR, END_COLOR);
 
     this->n_pixel = n_pixel;
 
-    energy_spectrum_file.open("../plots/data/energy_spectrum.txt", std::ios::out);
-    if (!energy_spectrum_file.is_open()) throw std::runtime_error("Impossible to open energy spectrum file.");
-
-    energy_spectrum_cs_file.open("../plots/data/energy_spectrum_cs.txt", std::ios::out);
-    if (!energy_spectrum_cs_file.is_open()) throw std::runtime_error("Impossible to open energy spectrum file.");
-
-    photon_energy_file.open("../plots/data/photon_energy.txt", std::ios::out);
-    if (!photon_energy_file.is_open()) throw std::runtime_error("Impossible to open photon energy file.");
-
     std::string root_filename = Options::get_instance().get_filename();
     root_filename.erase(root_filename.length() - 9, 9);
 
-    std::string filename_counts = "../plots/data/counts/counts_" + root_filename + ".txt";
-    counts_file.open(filename_counts, std::ios::out);
-    if (!counts_file.is_open()) throw std::runtime_error("Impossible to open counts file.");
+    dump_paths[DUMP_SPECTRUM] = "../plots/data/energy_spectrum";
+    dump_paths[DUMP_SPECTRUM_CS] = "../plots/data/energy_spectrum_cs";
+    dump_paths[DUMP_COUNTS] = "../plots/data/counts/counts_" + root_filename;
+    dump_paths[DUMP_PHOTON] = "../plots/data/photon_energy";
+
+    for (int i = 0; i < N_DUMPS; i++) {
+        dump_writers[i] = std::make_unique<DumpWriter>(dump_paths[i] + ".bin");
+        dumps[i].reserve(DUMP_BLOCK_SIZE);
+    }
 
     std::string filename_reconstruction = "../plots/data/counts/reconstruction_" + root_filename + ".txt";
     reconstruction_file.open(filename_reconstruction, std::ios::out);
     if (!reconstruction_file.is_open()) throw std::runtime_error("Impossible to open reconstruction file.");
 }
 
+/**
+ * The constructor of the worker copies.
+ *
+ * It creates empty histograms with the same binning
+ * as the master's ones (without the ROOT histograms),
+ * and keeps the dumped energies in memory until they
+ * are merged into the master.
+ *
+ * @param[in] master The histograms to copy.
+ */
+graphs::Histograms::Histograms(const Histograms &master)
+    : n_pixel(master.n_pixel)
+    , binning(master.binning)
+    , energy_spectrum(master.energy_spectrum)
+    , energy_spectrum_cs(master.energy_spectrum_cs)
+    , total_energy(master.total_energy)
+    , total_energy_cs(master.total_energy_cs)
+    , energy_pixels(master.energy_pixels)
+    , energy_pixels_cs(master.energy_pixels_cs)
+    , energy_central(master.energy_central)
+    , energy_t(master.energy_t)
+    , energy_tr(master.energy_tr)
+    , photon_energy(master.photon_energy)
+    , energy_central_corrected_reference(master.energy_central_corrected_reference)
+    , cluster_energy(master.cluster_energy)
+    , cluster_size(master.cluster_size)
+    , cluster_multiplicity(master.cluster_multiplicity)
+    , cluster_centroids(master.cluster_centroids)
+    , psf_info(master.psf_info)
+{
+    reset();
+}
+
 /**
  * The destructor.
  *
@@ -125,6 +180,18 @@ graphs::Histograms::~Histograms()
     delete hist_stack_corrections;
     hist_stack_corrections = nullptr;
 
+    delete hist_cluster_energy;
+    hist_cluster_energy = nullptr;
+
+    delete hist_cluster_size;
+    hist_cluster_size = nullptr;
+
+    delete hist_cluster_multiplicity;
+    hist_cluster_multiplicity = nullptr;
+
+    delete hist_cluster_centroids;
+    hist_cluster_centroids = nullptr;
+
     if (verbose) print_info("INFO - Histograms destroyed.\n");
 
     delete canvas_energy;
@@ -139,68 +206,183 @@ graphs::Histograms::~Histograms()
     delete canvas_reconstruction;
     canvas_reconstruction = nullptr;
 
+    delete canvas_clusters;
+    canvas_clusters = nullptr;
+
     if (verbose) print_info("INFO - Canvases destroyed.\n");
 
-    energy_spectrum_file.close();
-    energy_spectrum_cs_file.close();
-    photon_energy_file.close();
-    counts_file.close();
+    // the writers complete the files when destroyed
+    for (int i = 0; i < N_DUMPS; i++) {
+        if (dump_writers[i]) dump_writers[i]->submit(dumps[i]);
+    }
+
     reconstruction_file.close();
 }
 
+/**
+ * Function for creating a worker copy of the histograms,
+ * to be filled by a thread of the parallel event loop.
+ *
+ * @return The pointer to the copy.
+ */
+std::unique_ptr<graphs::Histograms> graphs::Histograms::make_worker_copy() const
+{
+    return std::unique_ptr<Histograms>(new Histograms(*this));
+}
+
+/**
+ * Function for adding the content of a worker copy
+ * to these histograms.
+ *
+ * The dumped energies of the worker are
+ * appended to the master's ones.
+ *
+ * @param[in] worker The worker copy to merge.
+ */
+void graphs::Histograms::merge(Histograms &worker)
+{
+    energy_spectrum.add(worker.energy_spectrum);
+    energy_spectrum_cs.add(worker.energy_spectrum_cs);
+    total_energy.add(worker.total_energy);
+    total_energy_cs.add(worker.total_energy_cs);
+    energy_pixels.add(worker.energy_pixels);
+    energy_pixels_cs.add(worker.energy_pixels_cs);
+    energy_central.add(worker.energy_central);
+    energy_t.add(worker.energy_t);
+    energy_tr.add(worker.energy_tr);
+    photon_energy.add(worker.photon_energy);
+    energy_central_corrected_reference.add(worker.energy_central_corrected_reference);
+    cluster_energy.add(worker.cluster_energy);
+    cluster_size.add(worker.cluster_size);
+    cluster_multiplicity.add(worker.cluster_multiplicity);
+    cluster_centroids.add(worker.cluster_centroids);
+
+    for (int i = 0; i < N_DUMPS; i++) {
+        dumps[i].insert(dumps[i].end(), worker.dumps[i].begin(), worker.dumps[i].end());
+        worker.dumps[i].clear();
+
+        if (dumps[i].size() >= DUMP_BLOCK_SIZE && dump_writers[i]) dump_writers[i]->submit(dumps[i]);
+    }
+}
+
+/**
+ * Function for emptying the histograms
+ * that are filled event by event.
+ */
+void graphs::Histograms::reset()
+{
+    energy_spectrum.reset();
+    energy_spectrum_cs.reset();
+    total_energy.reset();
+    total_energy_cs.reset();
+    energy_pixels.reset();
+    energy_pixels_cs.reset();
+    energy_central.reset();
+    energy_t.reset();
+    energy_tr.reset();
+    photon_energy.reset();
+    energy_central_corrected_reference.reset();
+    cluster_energy.reset();
+    cluster_size.reset();
+    cluster_multiplicity.reset();
+    cluster_centroids.reset();
+
+    for (auto &d : dumps)
+        d.clear();
+}
+
+/**
+ * Function for copying the histograms filled
+ * in the event loop into the ROOT ones.
+ */
+void graphs::Histograms::materialize()
+{
+    energy_spectrum.to_root(hist_energy_spectrum);
+    energy_spectrum_cs.to_root(hist_energy_spectrum_cs);
+    total_energy.to_root(hist_total_energy);
+    total_energy_cs.to_root(hist_total_energy_cs);
+    energy_pixels.to_root(hist_energy_pixels);
+    energy_pixels_cs.to_root(hist_energy_pixels_cs);
+    energy_central.to_root(hist_energy_central);
+    energy_t.to_root(hist_energy_t);
+    energy_tr.to_root(hist_energy_tr);
+    photon_energy.to_root(hist_photon_energy);
+    energy_central_corrected_reference.to_root(hist_energy_central_corrected_reference);
+    cluster_energy.to_root(hist_cluster_energy);
+    cluster_size.to_root(hist_cluster_size);
+    cluster_multiplicity.to_root(hist_cluster_multiplicity);
+    cluster_centroids.to_root(hist_cluster_centroids);
+
+    if (verbose) printf("%sINFO - Histograms copied into the ROOT ones.%s\n", INFO_COLOR, END_COLOR);
+}
+
 /**
  * Function for filling the histograms
  * with the energy in pixel 0, T and TR.
  *
- * @param[in] id The pixel ID.
+ * @param[in] role The role of the pixel (see `data::PixelRole`).
  * @param[in] energy The energy in the pixel.
  */
-void graphs::Histograms::fill_psf_histograms(int id, double energy)
+void graphs::Histograms::fill_psf_histograms(int role, double energy)
 {
-    if (id == psf_info->id_pixel_0) {
-        hist_energy_central->Fill(energy);
-        counts_file << energy << std::endl;
-    } else if (std::find(psf_info->id_pixel_t.begin(), psf_info->id_pixel_t.end(), id) != psf_info->id_pixel_t.end())
-        hist_energy_t->Fill(energy);
-    else if (std::find(psf_info->id_pixel_tr.begin(), psf_info->id_pixel_tr.end(), id) != psf_info->id_pixel_tr.end())
-        hist_energy_tr->Fill(energy);
+    switch (role) {
+    case data::ROLE_0:
+        energy_central.fill(energy);
+        dump(DUMP_COUNTS, energy);
+        break;
+    case data::ROLE_T:
+        energy_t.fill(energy);
+        break;
+    case data::ROLE_TR:
+        energy_tr.fill(energy);
+        break;
+    default:
+        break;
+    }
 }
 
 /**
- * Function for adding entries to the histograms.
+ * Function for adding the energies of
+ * an event to the energy spectrum.
  *
- * @param[in] v_id The vector containing the pixel IDs.
- * @param[in] v_energy The vector containing the pixel energies.
- * @param[in] CS Whether to fill the charge sharing histograms or the normal ones.
- * @param[in] print Whether to print the entry to the terminal.
+ * @param[in] energies The energies in the pixels.
+ * @param[in] CS Whether to fill the charge sharing histogram or the normal one.
  */
-void graphs::Histograms::fill_histograms(std::vector<Int_t> v_id, std::vector<Double_t> v_energy, bool CS, bool print)
+void graphs::Histograms::fill_spectrum(data::Span<Double_t> energies, bool CS)
 {
-    double total_energy = 0;
-    int limit = v_energy.size();
-    for (int i = 0; i < limit; i++) {
-        double energy = v_energy.at(i);
-
-        if (!CS) energy_spectrum_file << energy << "\n";
-        else energy_spectrum_cs_file << energy << "\n";
+    int column = (!CS) ? DUMP_SPECTRUM : DUMP_SPECTRUM_CS;
+    for (double energy : energies)
+        dump(column, energy);
 
-        total_energy += energy;
-        if (energy > 0) (!CS) ? hist_energy_spectrum->Fill(energy) : hist_energy_spectrum_cs->Fill(energy);
-
-        int ID = v_id.at(i);
-        int ID_y = ID / n_pixel;
-        int ID_x = ID - ID_y * n_pixel;
-        if (verbose) printf("%sDEBUG - ID_x = %i; ID_y = %i%s\n", DEBUG_COLOR, ID_x, ID_y, END_COLOR);
+    (!CS) ? energy_spectrum.fill_n(energies, true) : energy_spectrum_cs.fill_n(energies, true);
+}
 
-        (!CS) ? hist_energy_pixels->Fill(ID_x, ID_y, energy) : hist_energy_pixels_cs->Fill(ID_x, ID_y, energy);
+/**
+ * Function for adding a hit to the energy per pixel.
+ *
+ * @param[in] pixel The role and the coordinates of the pixel.
+ * @param[in] energy The energy in the pixel.
+ * @param[in] CS Whether to fill the charge sharing histogram or the normal one.
+ */
+void graphs::Histograms::fill_hit(const data::PixelInfo &pixel, double energy, bool CS)
+{
+    int ID_x = pixel.x;
+    int ID_y = pixel.y;
+    if (verbose) printf("%sDEBUG - ID_x = %i; ID_y = %i%s\n", DEBUG_COLOR, ID_x, ID_y, END_COLOR);
 
-        // fill 0, T and TR histograms
-        if (CS) fill_psf_histograms(ID, energy);
+    (!CS) ? energy_pixels.fill(ID_x, ID_y, energy) : energy_pixels_cs.fill(ID_x, ID_y, energy);
+}
 
-        if (print) printf("ID = %i; Energy = %f GeV\n", ID, energy);
-    }
-    (!CS) ? hist_total_energy->Fill(total_energy) : hist_total_energy_cs->Fill(total_energy);
-    if (print) printf("Total energy = %f GeV\n", total_energy);
+/**
+ * Function for filling the histograms
+ * with the total energy of an event.
+ *
+ * @param[in] energy The energy summed over all the pixels.
+ * @param[in] CS Whether to fill the charge sharing histogram or the normal one.
+ */
+void graphs::Histograms::fill_total_energy(double energy, bool CS)
+{
+    (!CS) ? total_energy.fill(energy) : total_energy_cs.fill(energy);
 
     if (verbose) {
         printf("%s\nINFO - Filled histograms ", INFO_COLOR);
@@ -214,16 +396,15 @@ void graphs::Histograms::fill_histograms(std::vector<Int_t> v_id, std::vector<Do
  *
  * @param[in] v_count The vector with the counts in each of the energy bins.
  */
-void graphs::Histograms::fill_results(std::vector<Int_t> v_counts)
+void graphs::Histograms::fill_results(const std::vector<long long> &v_counts)
 {
-    double max = options::Options::get_instance().get_max_threshold();
-    int N = options::Options::get_instance().get_n_thresholds();
-    double step = max / N;
+    int N = binning.n_thresholds;
+    double step = binning.get_step();
 
-    // corrected counts
+    // corrected counts (each bin is written with its upper edge)
     for (int i = 0; i < N; i++) {
         hist_energy_central_corrected->SetBinContent((i + 1), v_counts[i]);
-        reconstruction_file << (i + 1) * step << "  " << v_counts[i] << std::endl;
+        reconstruction_file << binning.min_threshold + (i + 1) * step << "  " << v_counts[i] << std::endl;
     }
 }
 
@@ -231,16 +412,11 @@ void graphs::Histograms::fill_results(std::vector<Int_t> v_counts)
  * Function for filling the histogram with the results
  * of the reference algorithm.
  *
- * @param[in] v_id The vector containing the pixel IDs.
- * @param[in] v_energy The vector containing the pixel energies.
+ * @param[in] energy The energy in pixel 0 after the clustering.
  */
-void graphs::Histograms::fill_reference(std::vector<Int_t> v_id, std::vector<Double_t> v_energy)
+void graphs::Histograms::fill_reference(double energy)
 {
-    Int_t id_0 = (n_pixel / 2) * (1 + n_pixel);
-
-    for (int i = 0; i < v_id.size(); i++) {
-        if (v_id[i] == id_0 && v_energy[i] > 0) hist_energy_central_corrected_reference->Fill(v_energy[i]);
-    }
+    if (energy > 0) energy_central_corrected_reference.fill(energy);
 }
 
 /**
@@ -251,8 +427,24 @@ void graphs::Histograms::fill_reference(std::vector<Int_t> v_id, std::vector<Dou
  */
 void graphs::Histograms::fill_photon_energy(Double_t energy)
 {
-    hist_photon_energy->Fill(energy);
-    photon_energy_file << energy << std::endl;
+    photon_energy.fill(energy);
+    dump(DUMP_PHOTON, energy);
+}
+
+/**
+ * Function for filling the histograms
+ * with the clusters of an event.
+ *
+ * @param[in] clusters The clusters found in the event.
+ */
+void graphs::Histograms::fill_clusters(const std::vector<clustering::Cluster> &clusters)
+{
+    cluster_multiplicity.fill(clusters.size());
+    for (const clustering::Cluster &c : clusters) {
+        cluster_energy.fill(c.energy);
+        cluster_size.fill(c.size);
+        cluster_centroids.fill(c.x, c.y);
+    }
 }
 
 /**
@@ -260,6 +452,8 @@ void graphs::Histograms::fill_photon_energy(Double_t energy)
  */
 void graphs::Histograms::show_histograms()
 {
+    materialize();
+
     canvas_energy = new TCanvas("Canvas E array", "Energy Spectrum and Total Energy", 1'000, 1'000);
     canvas_energy->Divide(2, 2);
     canvas_energy->cd(1);
@@ -329,8 +523,89 @@ void graphs::Histograms::show_histograms()
     hist_stack_corrections_reference->Draw("nostack");
     canvas_reconstruction->Update();
 
+    if (options::Options::get_instance().get_cluster_connectivity()) {
+        canvas_clusters = new TCanvas("Canvas clusters", "Clusters", 1'000, 1'000);
+        canvas_clusters->Divide(2, 2);
+        canvas_clusters->cd(1);
+        hist_cluster_energy->Draw();
+        hist_cluster_energy->SetDirectory(nullptr);
+        canvas_clusters->cd(2);
+        hist_cluster_multiplicity->Draw();
+        hist_cluster_multiplicity->SetDirectory(nullptr);
+        canvas_clusters->cd(3);
+        hist_cluster_size->Draw();
+        hist_cluster_size->SetDirectory(nullptr);
+        canvas_clusters->cd(4);
+        hist_cluster_centroids->Draw();
+        hist_cluster_centroids->SetDirectory(nullptr);
+        canvas_clusters->Update();
+    }
+
     if (verbose) printf("%sINFO - Canvases created.%s\n", INFO_COLOR, END_COLOR);
 
     TRootCanvas *rc = static_cast<TRootCanvas *>(canvas_energy->GetCanvasImp());
     rc->Connect("CloseWindow()", "TApplication", gApplication, "Terminate()");
 }
+
+/**
+ * Function for writing the histograms to a ROOT file,
+ * used instead of `show_histograms()` in batch mode.
+ *
+ * @param[in] path The path of the output ROOT file.
+ */
+void graphs::Histograms::save_histograms(const std::string &path)
+{
+    materialize();
+
+    TFile output_file(path.c_str(), "RECREATE");
+    if (!output_file.IsOpen()) throw std::runtime_error("Impossible to open histograms file.");
+
+    output_file.cd();
+    hist_energy_spectrum->Write();
+    hist_energy_spectrum_cs->Write();
+    hist_total_energy->Write();
+    hist_total_energy_cs->Write();
+    hist_energy_pixels->Write();
+    hist_energy_pixels_cs->Write();
+    hist_energy_central->Write();
+    hist_energy_t->Write();
+    hist_energy_tr->Write();
+    hist_photon_energy->Write();
+    hist_energy_central_corrected->Write();
+    hist_energy_central_corrected_reference->Write();
+    if (options::Options::get_instance().get_cluster_connectivity()) {
+        hist_cluster_energy->Write();
+        hist_cluster_size->Write();
+        hist_cluster_multiplicity->Write();
+        hist_cluster_centroids->Write();
+    }
+    output_file.Close();
+
+    printf("%sINFO - Histograms saved to %s.%s\n", INFO_COLOR, path.c_str(), END_COLOR);
+}
+
+/**
+ * Function for writing the remaining dumped energies
+ * and closing the binary files (a file not fully
+ * written is an error).
+ *
+ * If requested in the options, the files are
+ * also exported as text (one value per line).
+ */
+void graphs::Histograms::close_dumps()
+{
+    for (int i = 0; i < N_DUMPS; i++) {
+        if (!dump_writers[i]) continue;
+
+        dump_writers[i]->submit(dumps[i]);
+        bool written = dump_writers[i]->close();
+        dump_writers[i].reset();
+        if (!written) {
+            printf("%sERROR - Impossible to write %s.bin%s\n", ERROR_COLOR, dump_paths[i].c_str(), END_COLOR);
+            throw std::runtime_error("");
+        }
+
+        if (options::Options::get_instance().get_text_dumps())
+            DumpWriter::export_text(dump_paths[i] + ".bin", dump_paths[i] + ".txt");
+    }
+}
@@ -0,0 +1,171 @@
+#include "histogram.hh"
+
+#include <array>
+#include <cmath>
+
+/**
+ * The default constructor.
+ *
+ * @param[in] n_bins The number of bins.
+ * @param[in] x_min The lower edge of the first bin.
+ * @param[in] x_max The upper edge of the last bin.
+ */
+graphs::Hist1D::Hist1D(int n_bins, double x_min, double x_max)
+    : axis(n_bins, x_min, x_max)
+    , contents(n_bins + 2, 0.0)
+{
+}
+
+/**
+ * Function for adding an array of values to the histogram.
+ *
+ * The bins are computed in blocks, in a loop without
+ * dependencies which the compiler can vectorize, and
+ * the counts are added afterwards.
+ *
+ * @param[in] values The values.
+ * @param[in] positive_only Whether to skip the values that are not positive.
+ */
+void graphs::Hist1D::fill_n(data::Span<double> values, bool positive_only)
+{
+    constexpr int block = 64;
+    std::array<int, block> bins;
+    std::array<double, block> weights;
+
+    for (std::size_t first = 0; first < values.size(); first += block) {
+        int n = std::min<std::size_t>(block, values.size() - first);
+        const double *x = values.data() + first;
+
+        for (int i = 0; i < n; i++) {
+            bins[i] = axis.find_bin(x[i]);
+            weights[i] = positive_only ? static_cast<double>(x[i] > 0) : 1.0;
+        }
+
+        for (int i = 0; i < n; i++) {
+            contents[bins[i]] += weights[i];
+
+            double w_in = weights[i] * axis.in_range(bins[i]);
+            entries += weights[i];
+            sum_w += w_in;
+            sum_w2 += w_in;
+            sum_wx += w_in * x[i];
+            sum_wx2 += w_in * x[i] * x[i];
+        }
+    }
+}
+
+/**
+ * Function for adding the content of
+ * another histogram with the same binning.
+ *
+ * @param[in] other The histogram to add.
+ */
+void graphs::Hist1D::add(const Hist1D &other)
+{
+    for (int i = 0; i < contents.size(); i++)
+        contents[i] += other.contents[i];
+
+    entries += other.entries;
+    sum_w += other.sum_w;
+    sum_w2 += other.sum_w2;
+    sum_wx += other.sum_wx;
+    sum_wx2 += other.sum_wx2;
+}
+
+/**
+ * Function for emptying the histogram.
+ */
+void graphs::Hist1D::reset()
+{
+    std::fill(contents.begin(), contents.end(), 0.0);
+    entries = sum_w = sum_w2 = sum_wx = sum_wx2 = 0;
+}
+
+/**
+ * Function for copying the content of the
+ * histogram into a ROOT histogram with the
+ * same binning.
+ *
+ * @param[in] hist The ROOT histogram.
+ */
+void graphs::Hist1D::to_root(TH1 *hist) const
+{
+    hist->Reset();
+    for (int i = 0; i < contents.size(); i++)
+        hist->SetBinContent(i, contents[i]);
+
+    std::array<double, 4> stats{sum_w, sum_w2, sum_wx, sum_wx2};
+    hist->PutStats(stats.data());
+    hist->SetEntries(entries);
+}
+
+/**
+ * The default constructor.
+ *
+ * @param[in] n_bins_x The number of bins along x.
+ * @param[in] x_min The lower edge of the first bin along x.
+ * @param[in] x_max The upper edge of the last bin along x.
+ * @param[in] n_bins_y The number of bins along y.
+ * @param[in] y_min The lower edge of the first bin along y.
+ * @param[in] y_max The upper edge of the last bin along y.
+ */
+graphs::Hist2D::Hist2D(int n_bins_x, double x_min, double x_max, int n_bins_y, double y_min, double y_max)
+    : axis_x(n_bins_x, x_min, x_max)
+    , axis_y(n_bins_y, y_min, y_max)
+    , contents((n_bins_x + 2) * (n_bins_y + 2), 0.0)
+    , errors2((n_bins_x + 2) * (n_bins_y + 2), 0.0)
+{
+}
+
+/**
+ * Function for adding the content of
+ * another histogram with the same binning.
+ *
+ * @param[in] other The histogram to add.
+ */
+void graphs::Hist2D::add(const Hist2D &other)
+{
+    for (int i = 0; i < contents.size(); i++) {
+        contents[i] += other.contents[i];
+        errors2[i] += other.errors2[i];
+    }
+
+    entries += other.entries;
+    sum_w += other.sum_w;
+    sum_w2 += other.sum_w2;
+    sum_wx += other.sum_wx;
+    sum_wx2 += other.sum_wx2;
+    sum_wy += other.sum_wy;
+    sum_wy2 += other.sum_wy2;
+    sum_wxy += other.sum_wxy;
+}
+
+/**
+ * Function for emptying the histogram.
+ */
+void graphs::Hist2D::reset()
+{
+    std::fill(contents.begin(), contents.end(), 0.0);
+    std::fill(errors2.begin(), errors2.end(), 0.0);
+    entries = sum_w = sum_w2 = sum_wx = sum_wx2 = sum_wy = sum_wy2 = sum_wxy = 0;
+}
+
+/**
+ * Function for copying the content of the
+ * histogram into a ROOT histogram with the
+ * same binning.
+ *
+ * @param[in] hist The ROOT histogram.
+ */
+void graphs::Hist2D::to_root(TH2 *hist) const
+{
+    hist->Reset();
+    for (int i = 0; i < contents.size(); i++) {
+        hist->SetBinContent(i, contents[i]);
+        hist->SetBinError(i, std::sqrt(errors2[i]));
+    }
+
+    std::array<double, 7> stats{sum_w, sum_w2, sum_wx, sum_wx2, sum_wy, sum_wy2, sum_wxy};
+    hist->PutStats(stats.data());
+    hist->SetEntries(entries);
+}
@@ -7,17 +7,25 @@
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <vector>
 
 const std::filesystem::path options_path{"../utils/options.txt"};
 const std::filesystem::path results_path{"../results"};
-constexpr std::array<const char *, 6> options_keys{"ROOT_FILE", "N_THR",     "MIN_THR",
-                                                   "MAX_THR",   "VERBOSITY", "USE_PROBABILITIES"};
+constexpr std::array<const char *, 11> options_keys{"ROOT_FILE",           "N_THR",      "MIN_THR",
+                                                    "MAX_THR",             "VERBOSITY",  "USE_PROBABILITIES",
+                                                    "BATCH_MODE",          "N_THREADS",  "TEXT_DUMPS",
+                                                    "RECONSTRUCTION_ONLY", "EVENT_CACHE"};
 constexpr const char FILENAME_DEF[] = "uniform_mono.root";
 constexpr int N_THRESHOLDS_DEF = 50;
 constexpr double MIN_THRESHOLD_DEF = 0.0;
 constexpr double MAX_THRESHOLD_DEF = 0.11;
 constexpr bool VERBOSITY_DEF = false;
 constexpr bool USE_PROBABILITIES_DEF = false;
+constexpr bool BATCH_MODE_DEF = false;
+constexpr int N_THREADS_DEF = 1;
+constexpr bool TEXT_DUMPS_DEF = false;
+constexpr bool RECONSTRUCTION_ONLY_DEF = false;
+constexpr bool EVENT_CACHE_DEF = false;
 
 /**
  * Static function for accessing the singleton instance.
@@ -45,6 +53,11 @@ options::Options::Options()
     , verbosity(VERBOSITY_DEF)
     , opt_verbose(VERBOSITY_DEF)
     , use_probabilities(USE_PROBABILITIES_DEF)
+    , batch_mode(BATCH_MODE_DEF)
+    , n_threads(N_THREADS_DEF)
+    , text_dumps(TEXT_DUMPS_DEF)
+    , reconstruction_only(RECONSTRUCTION_ONLY_DEF)
+    , event_cache(EVENT_CACHE_DEF)
 {
     std::fstream options_file;
     options_file.open(options_path, std::ios::in);
@@ -60,7 +73,8 @@ options::Options::Options()
     while (!options_file.eof()) {
         options_file >> key >> value;
 
-        const auto &[ROOT_FILE, N_THR, MIN_THR, MAX_THR, VERBOSITY, USE_PROBABILITIES] = options_keys;
+        const auto &[ROOT_FILE, N_THR, MIN_THR, MAX_THR, VERBOSITY, USE_PROBABILITIES, BATCH_MODE, N_THREADS,
+                     TEXT_DUMPS, RECONSTRUCTION_ONLY, EVENT_CACHE] = options_keys;
 
         if (key == ROOT_FILE) filename = value;
         else if (key == N_THR) n_thresholds = std::stoi(value);
@@ -68,6 +82,11 @@ options::Options::Options()
         else if (key == MAX_THR) max_threshold = std::stod(value);
         else if (key == VERBOSITY) verbosity = std::stoi(value) != 0;
         else if (key == USE_PROBABILITIES) use_probabilities = std::stoi(value) != 0;
+        else if (key == BATCH_MODE) batch_mode = std::stoi(value) != 0;
+        else if (key == N_THREADS) n_threads = std::stoi(value);
+        else if (key == TEXT_DUMPS) text_dumps = std::stoi(value) != 0;
+        else if (key == RECONSTRUCTION_ONLY) reconstruction_only = std::stoi(value) != 0;
+        else if (key == EVENT_CACHE) event_cache = std::stoi(value) != 0;
         else continue;
     }
 
@@ -94,6 +113,11 @@ void options::Options::set_default()
     threshold_step = 0;
     verbosity = VERBOSITY_DEF;
     use_probabilities = USE_PROBABILITIES_DEF;
+    batch_mode = BATCH_MODE_DEF;
+    n_threads = N_THREADS_DEF;
+    text_dumps = TEXT_DUMPS_DEF;
+    reconstruction_only = RECONSTRUCTION_ONLY_DEF;
+    event_cache = EVENT_CACHE_DEF;
     opt_verbose = verbosity;
 
     if (previous_verbose) print_warning("\nOptions::set_default() - INFO - Set default options.\n");
@@ -119,7 +143,8 @@ void options::Options::save_to_file() const
     }
 
     int w = 50;
-    const auto &[ROOT_FILE, N_THR, MIN_THR, MAX_THR, VERBOSITY, USE_PROBABILITIES] = options_keys;
+    const auto &[ROOT_FILE, N_THR, MIN_THR, MAX_THR, VERBOSITY, USE_PROBABILITIES, BATCH_MODE, N_THREADS, TEXT_DUMPS,
+                  RECONSTRUCTION_ONLY, EVENT_CACHE] = options_keys;
 
     options_file << std::setw(w / 2) << ROOT_FILE << std::setw(w) << filename << "\n";
     options_file << std::setw(w / 2) << N_THR << std::setw(w) << n_thresholds << "\n";
@@ -127,6 +152,11 @@ void options::Options::save_to_file() const
     options_file << std::setw(w / 2) << MAX_THR << std::setw(w) << max_threshold << "\n";
     options_file << std::setw(w / 2) << VERBOSITY << std::setw(w) << verbosity << "\n";
     options_file << std::setw(w / 2) << USE_PROBABILITIES << std::setw(w) << use_probabilities << "\n";
+    options_file << std::setw(w / 2) << BATCH_MODE << std::setw(w) << batch_mode << "\n";
+    options_file << std::setw(w / 2) << N_THREADS << std::setw(w) << n_threads << "\n";
+    options_file << std::setw(w / 2) << TEXT_DUMPS << std::setw(w) << text_dumps << "\n";
+    options_file << std::setw(w / 2) << RECONSTRUCTION_ONLY << std::setw(w) << reconstruction_only << "\n";
+    options_file << std::setw(w / 2) << EVENT_CACHE << std::setw(w) << event_cache << "\n";
 
     options_file.close();
 
@@ -147,6 +177,8 @@ std::string options::Options::results_files()
 
     int counter = 0;
     for (const auto &entry : std::filesystem::directory_iterator(results_path)) {
+        if (entry.path().extension() != ".root") continue;
+
         printf("%i. %s\n", counter, entry.path().c_str());
         filenames.push_back(entry.path());
         counter++;
@@ -164,7 +196,8 @@ std::string options::Options::results_files()
  */
 void options::Options::print_options() const
 {
-    const auto &[ROOT_FILE, N_THR, MIN_THR, MAX_THR, VERBOSITY, USE_PROBABILITIES] = options_keys;
+    const auto &[ROOT_FILE, N_THR, MIN_THR, MAX_THR, VERBOSITY, USE_PROBABILITIES, BATCH_MODE, N_THREADS, TEXT_DUMPS,
+                  RECONSTRUCTION_ONLY, EVENT_CACHE] = options_keys;
 
     printf("\n");
     printf("1) %s = %s\n", ROOT_FILE, filename.c_str());
@@ -173,6 +206,11 @@ void options::Options::print_options() const
     printf("4) %s = %.3f GeV\n", MAX_THR, max_threshold);
     printf("5) %s = %i\n", VERBOSITY, verbosity);
     printf("6) %s = %i\n", USE_PROBABILITIES, use_probabilities);
+    printf("7) %s = %i\n", BATCH_MODE, batch_mode);
+    printf("8) %s = %i\n", N_THREADS, n_threads);
+    printf("9) %s = %i\n", TEXT_DUMPS, text_dumps);
+    printf("a) %s = %i\n", RECONSTRUCTION_ONLY, reconstruction_only);
+    printf("b) %s = %i\n", EVENT_CACHE, event_cache);
 }
 
 /**
@@ -185,7 +223,7 @@ void options::Options::change_options()
         clear_screen();
         print_options();
         printf("\nType:\n");
-        printf("- 'number' to change the corresponding option;\n");
+        printf("- 'number' or 'letter' to change the corresponding option;\n");
         printf("- 'd' to set the default options;\n");
         printf("- 'x' to go back\n");
 
@@ -223,6 +261,26 @@ void options::Options::change_options()
             std::getline(std::cin, input);
             use_probabilities = static_cast<bool>(std::stoi(input));
             break;
+        case '7':
+            std::getline(std::cin, input);
+            batch_mode = static_cast<bool>(std::stoi(input));
+            break;
+        case '8':
+            std::getline(std::cin, input);
+            n_threads = std::stoi(input);
+            break;
+        case '9':
+            std::getline(std::cin, input);
+            text_dumps = static_cast<bool>(std::stoi(input));
+            break;
+        case 'a':
+            std::getline(std::cin, input);
+            reconstruction_only = static_cast<bool>(std::stoi(input));
+            break;
+        case 'b':
+            std::getline(std::cin, input);
+            event_cache = static_cast<bool>(std::stoi(input));
+            break;
         case 'd':
             done = true;
             set_default();
@@ -234,7 +292,8 @@ void options::Options::change_options()
         default:
             break;
         }
-        if (num != '1' && num != '5' && num != 6)
+        if (num != '1' && num != '5' && num != '6' && num != '7' && num != '8' && num != '9' &&
+            num != 'a' && num != 'b')
             threshold_step = (n_thresholds) ? (max_threshold - min_threshold) / n_thresholds : 0;
     } while (!done);
 
@@ -242,3 +301,64 @@ void options::Options::change_options()
 
     save_to_file();
 }
+
+/**
+ * Function for overriding the options with
+ * the command-line arguments.
+ *
+ * Recognized arguments:
+ * - `--batch` to run without menus, prompts and graphics;
+ * - `--file <name>` to choose the ROOT file in ../results/;
+ * - `--threads <n>` to set the number of threads of the batch event loop;
+ * - `--text-dumps` to also export the energy dumps as text files;
+ * - `--reconstruction-only` to read and process only the charge sharing hits;
+ * - `--event-cache` to convert the Event tree into an event cache and read the events from it;
+ * - `--no-event-cache` to read the events from the ROOT file instead of the event cache;
+ * - `--sweep <file>` to also reconstruct the spectrum with the binnings listed in the file;
+ * - `--calibrate-with <name>` to compute the transition probabilities from another ROOT file in ../results/;
+ * - `--calibration-entries <n>` to compute them from the first n entries of the ROOT file;
+ * - `--pixel-map` to also reconstruct the spectrum of every pixel of the array;
+ * - `--clusters <4|8>` to search the clusters of the hits with 4- or 8-connectivity;
+ * - `--cluster-threshold <e>` to ignore the hits below the energy e when searching the clusters;
+ * - `--psf-radius <r>` to also count the outer classes of a (2r + 1) x (2r + 1) PSF (the reconstruction uses 3x3);
+ * - `--photon-energy-range <min> <max>` to keep only the events with photon energy in [min, max);
+ * - `--hits-range <min> <max>` to keep only the events with min to max charge sharing hits (no maximum if negative);
+ * - `--psf-hit` to keep only the events with at least a charge sharing hit in the PSF.
+ *
+ * The overrides are not saved to the options file.
+ *
+ * @param[in] argc The number of arguments.
+ * @param[in] argv The arguments.
+ */
+void options::Options::parse_arguments(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--batch") batch_mode = true;
+        else if (arg == "--file" && i + 1 < argc) filename = argv[++i];
+        else if (arg == "--threads" && i + 1 < argc) n_threads = std::stoi(argv[++i]);
+        else if (arg == "--text-dumps") text_dumps = true;
+        else if (arg == "--reconstruction-only") reconstruction_only = true;
+        else if (arg == "--event-cache") event_cache = true;
+        else if (arg == "--no-event-cache") event_cache = false;
+        else if (arg == "--sweep" && i + 1 < argc) sweep_file = argv[++i];
+        else if (arg == "--calibrate-with" && i + 1 < argc) calibration_file = argv[++i];
+        else if (arg == "--calibration-entries" && i + 1 < argc) calibration_entries = std::stoll(argv[++i]);
+        else if (arg == "--pixel-map") pixel_map = true;
+        else if (arg == "--clusters" && i + 1 < argc) cluster_connectivity = std::stoi(argv[++i]);
+        else if (arg == "--cluster-threshold" && i + 1 < argc) cluster_threshold = std::stod(argv[++i]);
+        else if (arg == "--psf-radius" && i + 1 < argc) psf_radius = std::stoi(argv[++i]);
+        else if (arg == "--photon-energy-range" && i + 2 < argc) {
+            min_photon_energy = std::stod(argv[++i]);
+            max_photon_energy = std::stod(argv[++i]);
+        } else if (arg == "--hits-range" && i + 2 < argc) {
+            min_hits = std::stoi(argv[++i]);
+            max_hits = std::stoi(argv[++i]);
+        } else if (arg == "--psf-hit") psf_hit = true;
+        else printf("%sOptions::parse_arguments() - WARNING - Unknown argument %s%s\n", WARNING_COLOR, arg.c_str(),
+                    END_COLOR);
+    }
+
+    if (opt_verbose) print_info("Options::parse_arguments() - INFO - Parsed command-line arguments.");
+}
@@ -1,63 +1,141 @@
 #include "pixel_collection.hh"
 
 #include "options.hh"
+#include "psf_stencil.hh"
 #include "solve_system.hh"
 
+#include <algorithm>
 #include <cmath>
 #include <filesystem>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 
 bool pixel::PixelCollection::verbose = false;
 
 const std::filesystem::path and_path{"../output/0T_and_matrix.csv"};
+const std::filesystem::path and_tr_path{"../output/0TR_and_matrix.csv"};
+const std::filesystem::path and_t_tr_path{"../output/0T_TR_and_tensor.csv"};
 const std::filesystem::path counts_path{"../output/pixel_0_counts.csv"};
+const std::filesystem::path outer_counts_path{"../output/outer_counts.csv"};
 const std::filesystem::path probabilities_path{"../output/transition_probabilities.csv"};
 
 /**
- * The default constructor.
- *
- * @param[in] psf The pointer to the structure containing the info about
- * the point spread function to consider.
+ * Function for returning the binning
+ * set in the options.
  */
-pixel::PixelCollection::PixelCollection(std::shared_ptr<data::PSFInfo> psf)
-    : psf_info(psf)
+pixel::Binning pixel::Binning::from_options()
 {
     options::Options &opt = options::Options::get_instance();
 
-    bin_size = opt.get_threshold_step();
-    int n_thr = opt.get_n_thresholds();
+    return {opt.get_n_thresholds(), opt.get_min_threshold(), opt.get_max_threshold()};
+}
+
+/**
+ * Function for reading the binnings of a sweep.
+ *
+ * Each line of the file contains N_THR, MIN_THR and MAX_THR
+ * separated by commas or spaces; empty lines and lines
+ * starting with '#' are skipped.
+ *
+ * @param[in] path The path of the file.
+ * @return The binnings, in the order of the file.
+ */
+std::vector<pixel::Binning> pixel::Binning::read_file(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
 
-    for (int i = 0; i < n_thr; i++) {
-        energy_measured[0].push_back(0);
-        energy_measured[1].push_back(0);
+    std::vector<Binning> binnings;
+    std::string line;
+    for (int n_line = 1; std::getline(file, line); n_line++) {
+        if (line.empty() || line[0] == '#') continue;
+        std::replace(line.begin(), line.end(), ',', ' ');
+
+        Binning binning{};
+        std::istringstream values(line);
+        if (!(values >> binning.n_thresholds >> binning.min_threshold >> binning.max_threshold) ||
+            binning.n_thresholds <= 0 || binning.max_threshold <= binning.min_threshold) {
+            printf("%sERROR - Invalid binning at line %i of %s%s\n", ERROR_COLOR, n_line, path.c_str(), END_COLOR);
+            throw std::runtime_error("");
+        }
+        binnings.push_back(binning);
+    }
 
-        energy_corrected[0].push_back(0);
-        energy_corrected[1].push_back(0);
+    return binnings;
+}
 
-        counts_and[0].push_back(std::vector<int>(n_thr, 0));
+/**
+ * The default constructor.
+ *
+ * @param[in] psf The pointer to the structure containing the info about
+ * the point spread function to consider.
+ * @param[in] binning The energy binning of the counts.
+ * @param[in] beam_width The type of illumination: 0 for central pixel, 1 for the whole array.
+ */
+pixel::PixelCollection::PixelCollection(std::shared_ptr<data::PSFInfo> psf, const Binning &binning, int beam_width)
+    : binning(binning)
+    , indexer(binning)
+    , sum_offset(binning.get_sum_offset())
+    , psf_info(psf)
+    , flood(beam_width == 1)
+{
+    int n_thr = binning.n_thresholds;
+
+    for (int type = 0; type < MAX_PSF_ELEMENTS; type++) {
+        energy_measured[type] = CounterArray<std::uint32_t>(n_thr);
+        energy_corrected[type].assign(n_thr, 0);
+    }
+    if (!flood) energy_outer.assign(psf_info->get_n_roles() - MAX_PSF_ELEMENTS, CounterArray<std::uint32_t>(n_thr));
+    for (auto &c : counts_and)
+        c = CorrelationMatrix(n_thr);
+    counts_and_t_tr = CoincidenceTensor(n_thr);
+    anti_diagonal_sums.assign(n_thr, 0);
+    column_sums.assign(n_thr, 0);
+
+    event_counts[0].type = data::ROLE_0;
+    for (int i = 0; i < PSF_NEIGHBOURS; i++) {
+        event_counts[1 + i].type = data::ROLE_T;
+        event_counts[1 + PSF_NEIGHBOURS + i].type = data::ROLE_TR;
     }
 
-    for (int i = 0; i < event_counts.size(); i++)
-        event_counts[i].type = i;
+    if (flood) event_bins.assign(psf_info->pixels.size(), -1);
+
+    // the kernel is chosen once, so the loop over the hits knows the roles of the PSF at compile time
+    switch (psf_info->radius) {
+    case 1:
+        fill_kernel = &PixelCollection::fill_hits_radius<1>;
+        break;
+    case 2:
+        fill_kernel = &PixelCollection::fill_hits_radius<2>;
+        break;
+    case 3:
+        fill_kernel = &PixelCollection::fill_hits_radius<3>;
+        break;
+    default:
+        printf("%sERROR - The radius of the PSF must be 1, 2 or 3, not %i%s\n", ERROR_COLOR, psf_info->radius,
+               END_COLOR);
+        throw std::runtime_error("");
+    }
 }
 
 /**
  * Function for filling the energy bins
  * of the pixel with the counts.
  *
- * @param[in] energy The energy of the event.
+ * @param[in] bin The energy bin of the hit.
  * @param[in] type The type of pixel to consider (0 (0), 1 (T), 2 (TR),...).
  */
-void pixel::PixelCollection::fill_collection(double energy, int type)
+void pixel::PixelCollection::fill_collection(int bin, int type)
 {
     // add count
-    energy_measured[type][get_bin(energy)]++;
+    energy_measured[type].increment(bin);
 
-    constexpr std::array<const char *, 2> debug = {"0", "T"};
-    if (verbose)
-        printf("%sDEBUG - Pixel %s - Energy %.4f GeV - Bin %i%s\n", DEBUG_COLOR, debug[type], energy, get_bin(energy),
-               END_COLOR);
+    constexpr std::array<const char *, MAX_PSF_ELEMENTS> debug = {"0", "T", "TR"};
+    if (verbose) printf("%sDEBUG - Pixel %s - Bin %i%s\n", DEBUG_COLOR, debug[type], bin, END_COLOR);
 }
 
 /**
@@ -71,47 +149,127 @@ void pixel::PixelCollection::print_correlations() const
     for (int i = 0; i < counts_and[0].size(); i++) {
         if (!i) {
             printf("     ");
-            for (int i = 0; i < counts_and[0][0].size(); i++)
+            for (int i = 0; i < counts_and[0].size(); i++)
                 printf("%6i ", i);
             printf("\n     ");
-            for (int i = 0; i < counts_and[0][0].size(); i++)
+            for (int i = 0; i < counts_and[0].size(); i++)
                 printf("------ ");
 
             printf("\n");
         }
 
         printf("%2i | ", i);
-        for (int d : counts_and[0][i])
-            printf("%6i ", d);
+        for (int j = 0; j < counts_and[0].size(); j++)
+            printf("%6llu ", static_cast<unsigned long long>(counts_and[0](i, j)));
 
         printf("\n");
     }
 }
 
 /**
- * Function for adding an event to the
- * pixel collection.
- *
- * @param[in] v_id The vector with the IDs of the pixels.
- * @param[in] v_energy The vector with the energy deposited in the pixels.
+ * Function for starting a new event.
  */
-void pixel::PixelCollection::add_event(std::vector<int> v_id, std::vector<double> v_energy)
+void pixel::PixelCollection::begin_event()
 {
     for (auto &e : event_counts)
         e.reset();
+}
 
-    for (int i = 0; i < v_id.size(); i++) {
-        int id = v_id[i];
-        double energy = v_energy[i];
-        double bin = get_bin(energy);
-
-        if (id == psf_info->id_pixel_0) {
-            fill_collection(energy, 0);
-            event_counts[0].bin = bin;
-        } else if (id == psf_info->id_pixel_t[0]) {
-            fill_collection(energy, 1);
-            event_counts[1].bin = bin;
+/**
+ * Function for adding the hits of the current
+ * event to the pixel collection.
+ *
+ * The energies of the whole event are binned at once,
+ * then the hits are added by the kernel of the PSF radius.
+ *
+ * @param[in] ids The IDs of the pixels hit.
+ * @param[in] energies The energies deposited in the pixels.
+ */
+void pixel::PixelCollection::fill_hits(data::Span<Int_t> ids, data::Span<Double_t> energies)
+{
+    hit_bins.resize(energies.size());
+    indexer(energies.data(), hit_bins.data(), energies.size());
+
+    (this->*fill_kernel)(ids, hit_bins.data());
+}
+
+/**
+ * Function for adding the hits of the current event
+ * with a PSF of radius `RADIUS`.
+ *
+ * The # of roles is known at compile time, so with a 3x3
+ * PSF the branch of the outer classes is not generated,
+ * and otherwise their counters are indexed with no checks
+ * on the radius (central beam only).
+ *
+ * @param[in] ids The IDs of the pixels hit.
+ * @param[in] bins The energy bins of the hits, in [-1, N].
+ */
+template <int RADIUS> void pixel::PixelCollection::fill_hits_radius(data::Span<Int_t> ids, const int *bins)
+{
+    constexpr int N_ROLES = data::PSFStencil<RADIUS>::N_CLASSES + 1;
+
+    for (std::size_t i = 0; i < ids.size(); i++) {
+        const data::PixelInfo &pixel = psf_info->get_pixel(ids[i]);
+
+        if constexpr (N_ROLES > MAX_PSF_ELEMENTS) {
+            if (!flood && pixel.role >= MAX_PSF_ELEMENTS && pixel.role < N_ROLES) {
+                if (bins[i] >= 0 && bins[i] < binning.n_thresholds)
+                    energy_outer[pixel.role - MAX_PSF_ELEMENTS].increment(bins[i]);
+                continue;
+            }
         }
+
+        fill_hit(pixel, bins[i]);
+    }
+}
+
+/**
+ * Function for adding a hit of the current
+ * event to the pixel collection.
+ *
+ * The hits in the four T (TR) pixels are added to the same
+ * spectrum, since they are equivalent by symmetry.
+ *
+ * @param[in] pixel The role of the pixel.
+ * @param[in] bin The energy bin of the hit, in [-1, N].
+ */
+void pixel::PixelCollection::fill_hit(const data::PixelInfo &pixel, int bin)
+{
+    static_assert(data::ROLE_0 == 0 && data::ROLE_T == 1 && data::ROLE_TR == 2, "the roles are the types");
+    int type = pixel.role;
+    if (!flood && type >= MAX_PSF_ELEMENTS) return;
+
+    // the binnings of a sweep may not cover the whole spectrum (counted only for a central beam)
+    if (bin == BinIndexer::UNDERFLOW_BIN || bin == binning.n_thresholds) {
+        if (!flood) (bin < 0) ? underflow[type]++ : overflow[type]++;
+        return;
+    }
+
+    // with flood illumination the hits are used when the event is closed
+    if (flood) {
+        int id = pixel.y * psf_info->n_pixel + pixel.x;
+        if (event_bins[id] < 0) event_hits.push_back(id);
+        event_bins[id] = bin;
+        return;
+    }
+
+    int slot = (type) ? 1 + (type - 1) * PSF_NEIGHBOURS + pixel.index : 0;
+
+    fill_collection(bin, type);
+    event_counts[slot].bin = bin;
+}
+
+/**
+ * Function for closing the current event,
+ * which adds the coincidences of 0 with each
+ * T and TR pixel to the correlation matrices.
+ */
+void pixel::PixelCollection::end_event()
+{
+    if (flood) {
+        end_event_flood();
+        return;
     }
 
     if (verbose) {
@@ -121,7 +279,21 @@ void pixel::PixelCollection::add_event(std::vector<int> v_id, std::vector<double
         printf(END_COLOR);
     }
 
-    if (event_counts[0].bin >= 0 && event_counts[1].bin >= 0) counts_and[0][event_counts[0].bin][event_counts[1].bin]++;
+    int bin_0 = event_counts[0].bin;
+    if (bin_0 >= 0) {
+        for (int slot = 1; slot < PSF_PIXELS; slot++) {
+            int bin = event_counts[slot].bin;
+            if (bin < 0) continue;
+
+            add_coincidence(event_counts[slot].type, bin_0, bin);
+        }
+
+        for (const auto &[t, tr] : CORNER_PAIRS) {
+            int bin_t = event_counts[1 + t].bin;
+            int bin_tr = event_counts[1 + PSF_NEIGHBOURS + tr].bin;
+            if (bin_t >= 0 && bin_tr >= 0) counts_and_t_tr.increment(bin_0, bin_t, bin_tr);
+        }
+    }
 
     if (verbose) {
         printf(DEBUG_COLOR);
@@ -131,53 +303,175 @@ void pixel::PixelCollection::add_event(std::vector<int> v_id, std::vector<double
 }
 
 /**
- * Function for reconstruction the energy spectrum
- * of the pixels (right now just 0).
+ * Function for adding a coincidence between
+ * the pixel 0 and a T or TR pixel.
  *
- * @param[in] beam_width The type of illumination: 0 for central pixel, 1 for the whole array.
+ * @param[in] type The type of the other pixel (1 (T), 2 (TR)).
+ * @param[in] bin_0 The energy bin of the pixel 0.
+ * @param[in] bin The energy bin of the other pixel.
  */
-void pixel::PixelCollection::reconstruct_spectrum(int beam_width)
+void pixel::PixelCollection::add_coincidence(int type, int bin_0, int bin)
 {
-    int N = options::Options::get_instance().get_n_thresholds();
-    bool opt = options::Options::get_instance().get_use_probabilities();
+    counts_and[type - 1].increment(bin_0, bin);
 
-    // generate probabilities
-    if (!opt) {
-        // get corrected counts
-        for (int i = 0; i < N; i++) {
-            int correction_1 = 0;
-            int correction_2 = 0;
+    int sum = bin_0 + bin + sum_offset;
+    if (type == data::ROLE_T && sum >= 0 && sum < binning.n_thresholds) {
+        anti_diagonal_sums[sum]++;
+        column_sums[bin]++;
+    }
+}
 
-            for (int j = 1; j < N - i; j++)
-                correction_1 += counts_and[0][j][i];
+/**
+ * Function for closing the current event
+ * with the whole array illuminated.
+ *
+ * Each interior pixel hit is a pixel 0, whose coincidences with
+ * the T and TR pixels around it are added. Each pixel hit is also
+ * a T (TR) pixel of the interior pixels around it, whether they
+ * were hit or not, as the T (TR) pixels for a central beam.
+ * The pixels on the edges are never a pixel 0, since some of their
+ * neighbours are missing, but they are T or TR pixels.
+ */
+void pixel::PixelCollection::end_event_flood()
+{
+    const data::PSFInfo &psf = *psf_info;
 
-            for (int j = 0; j < i; j++)
-                correction_2 += counts_and[0][i - j][j];
+    for (int id : event_hits) {
+        int bin = event_bins[id];
+        const auto &neighbours = psf.neighbours[id];
 
-            energy_corrected[0][i] =
-                energy_measured[0][i] - 4 * correction_1 + 4 * correction_2 - 2 * counts_and[0][i][0];
-        }
+        if (psf.pixels[id].interior) {
+            energy_measured[0].increment(bin);
 
-        // get transition probabilities
-        for (int i = 0; i < N; i++) {
-            std::vector<double> row;
-            row.reserve(N);
+            for (int k = 0; k < neighbours.size(); k++) {
+                int other = neighbours[k];
+                if (event_bins[other] < 0) continue;
+                add_coincidence((k < PSF_NEIGHBOURS) ? data::ROLE_T : data::ROLE_TR, bin, event_bins[other]);
+            }
 
-            for (int j = 0; j < N; j++) {
-                double probability = 4. * counts_and[0][i][j] / energy_corrected[0][i + j];
-                if (std::isnan(probability) || probability < 0) probability = 0.0;
-                else if (probability > 2) probability = 2;
-                row.push_back(probability);
+            for (const auto &[t, tr] : CORNER_PAIRS) {
+                int bin_t = event_bins[neighbours[t]];
+                int bin_tr = event_bins[neighbours[PSF_NEIGHBOURS + tr]];
+                if (bin_t >= 0 && bin_tr >= 0) counts_and_t_tr.increment(bin, bin_t, bin_tr);
             }
+        }
 
-            transition_probabilities.push_back(row);
-            row.clear();
+        // the neighbour relation is symmetric
+        for (int k = 0; k < neighbours.size(); k++) {
+            int other = neighbours[k];
+            if (other >= 0 && psf.pixels[other].interior) energy_measured[(k < PSF_NEIGHBOURS) ? 1 : 2].increment(bin);
         }
-        return;
     }
 
-    // use probabilities
-    energy_corrected[0] = solve_system::solve(energy_measured[0]);
+    for (int id : event_hits)
+        event_bins[id] = -1;
+    event_hits.clear();
+
+    if (verbose) {
+        printf(DEBUG_COLOR);
+        print_correlations();
+        printf(END_COLOR);
+    }
+}
+
+/**
+ * Function for adding the counts of another
+ * pixel collection to this one.
+ *
+ * @param[in] other The pixel collection to merge.
+ */
+void pixel::PixelCollection::merge(const PixelCollection &other)
+{
+    for (int type = 0; type < MAX_PSF_ELEMENTS; type++) {
+        energy_measured[type].add(other.energy_measured[type]);
+        underflow[type] += other.underflow[type];
+        overflow[type] += other.overflow[type];
+    }
+    for (int k = 0; k < energy_outer.size(); k++)
+        energy_outer[k].add(other.energy_outer[k]);
+
+    for (int type = 1; type < MAX_PSF_ELEMENTS; type++)
+        counts_and[type - 1].add(other.counts_and[type - 1]);
+    counts_and_t_tr.add(other.counts_and_t_tr);
+
+    for (int i = 0; i < anti_diagonal_sums.size(); i++) {
+        anti_diagonal_sums[i] += other.anti_diagonal_sums[i];
+        column_sums[i] += other.column_sums[i];
+    }
+}
+
+/**
+ * Function for setting all the counts to 0.
+ */
+void pixel::PixelCollection::reset()
+{
+    for (auto &v : energy_measured)
+        v.reset();
+    for (auto &v : energy_outer)
+        v.reset();
+    underflow.fill(0);
+    overflow.fill(0);
+
+    for (auto &c : counts_and)
+        c.reset();
+    counts_and_t_tr.reset();
+
+    std::fill(anti_diagonal_sums.begin(), anti_diagonal_sums.end(), 0);
+    std::fill(column_sums.begin(), column_sums.end(), 0);
+}
+
+/**
+ * Function for computing the corrected counts
+ * and the transition probabilities from the
+ * correlation matrix.
+ *
+ * The corrections of the bin i are the counts of the column i
+ * and of the anti-diagonal i (without the coincidences where 0
+ * is in the bin 0), which are summed while filling the matrix,
+ * so they cost O(N) overall.
+ *
+ * The 0-T coincidences are summed over the four T pixels, so they
+ * already include the factor 4 of the coincidences with one T pixel.
+ * The energies of 0 and T in the bins i and j add up to the bin
+ * i + j + sum_offset, the anti-diagonal i + j + sum_offset, since
+ * each of them is counted from MIN_THR.
+ */
+void pixel::PixelCollection::compute_transition_probabilities()
+{
+    int N = binning.n_thresholds;
+    transition_probabilities = {N, {}};
+
+    // get corrected counts
+    for (int i = 0; i < N; i++) {
+        int j_0 = i - sum_offset; // bin of T on the anti-diagonal i when 0 is in the bin 0
+        long long measured = energy_measured[0][i];
+        long long correction_1 = column_sums[i] - ((i + sum_offset < N) ? counts_and[0](0, i) : 0);
+        long long correction_2 = anti_diagonal_sums[i] - ((j_0 >= 0 && j_0 < N) ? counts_and[0](0, j_0) : 0);
+
+        energy_corrected[0][i] = std::llround(measured - correction_1 + correction_2 - 0.5 * counts_and[0](i, 0));
+    }
+
+    // get transition probabilities (0 if the sum of the energies of 0 and T falls outside the binning),
+    // only from the bins with coincidences, which are visited in row-major order
+    counts_and[0].for_each_nonzero([&](int i, int j, std::uint64_t counts) {
+        int sum = i + j + sum_offset;
+        if (sum < 0 || sum >= N) return;
+
+        double probability = static_cast<double>(counts) / energy_corrected[0][sum];
+        if (std::isnan(probability) || probability <= 0) return;
+        transition_probabilities.cells.push_back({i, j, std::min(probability, 2.0)});
+    });
+}
+
+/**
+ * Function for reconstructing the spectrum with
+ * transition probabilities already in memory.
+ *
+ * @param[in] solver The solver built from the transition probabilities.
+ */
+void pixel::PixelCollection::apply_transition_probabilities(const solve_system::Solver &solver)
+{
+    energy_corrected[0] = solve_system::solve(energy_measured[0].to_vector(), solver);
 }
 
 /**
@@ -189,17 +483,36 @@ void pixel::PixelCollection::print_counts() const
     printf("PIXEL 0\n");
     printf("-------\n");
     for (int i = 0; i < energy_measured[0].size(); i++)
-        printf("Bin %i: %i counts\n", i, energy_measured[0][i]);
+        printf("Bin %i: %llu counts\n", i, static_cast<unsigned long long>(energy_measured[0][i]));
+    printf("Underflow: %lld counts, overflow: %lld counts\n", underflow[0], overflow[0]);
 
     printf("\n");
 
-    printf("PIXEL T\n");
-    printf("-------\n");
+    printf("PIXELS T\n");
+    printf("--------\n");
     for (int i = 0; i < energy_measured[1].size(); i++)
-        printf("Bin %i: %i counts\n", i, energy_measured[1][i]);
+        printf("Bin %i: %llu counts\n", i, static_cast<unsigned long long>(energy_measured[1][i]));
+    printf("Underflow: %lld counts, overflow: %lld counts\n", underflow[1], overflow[1]);
 
     printf("\n");
 
+    printf("PIXELS TR\n");
+    printf("---------\n");
+    for (int i = 0; i < energy_measured[2].size(); i++)
+        printf("Bin %i: %llu counts\n", i, static_cast<unsigned long long>(energy_measured[2][i]));
+    printf("Underflow: %lld counts, overflow: %lld counts\n", underflow[2], overflow[2]);
+
+    printf("\n");
+
+    for (int k = 0; k < energy_outer.size(); k++) {
+        printf("PIXELS OF CLASS %i\n", k + MAX_PSF_ELEMENTS - 1);
+        printf("------------------\n");
+        for (int i = 0; i < energy_outer[k].size(); i++)
+            printf("Bin %i: %llu counts\n", i, static_cast<unsigned long long>(energy_outer[k][i]));
+
+        printf("\n");
+    }
+
     print_correlations();
 
     printf("\n");
@@ -207,14 +520,16 @@ void pixel::PixelCollection::print_counts() const
     printf("PIXEL 0 CORRECTED\n");
     printf("-----------------\n");
     for (int i = 0; i < energy_corrected[0].size(); i++)
-        printf("Bin %i: %i counts\n", i, energy_corrected[0][i]);
+        printf("Bin %i: %lld counts\n", i, energy_corrected[0][i]);
 }
 
 /**
  * Function for saving the results of the analysis
  * to a .txt file.
+ *
+ * @param[in] save_probabilities Whether to also save the transition probabilities.
  */
-void pixel::PixelCollection::save_output()
+void pixel::PixelCollection::save_output(bool save_probabilities)
 {
     std::fstream and_file;
     std::fstream counts_file;
@@ -228,29 +543,75 @@ void pixel::PixelCollection::save_output()
     for (int i = 0; i < energy_measured[0].size(); i++)
         counts_file << i << "," << energy_measured[0][i] << "\n";
 
-    // save and
-    and_file.open(and_path, std::ios::out);
-    if (!and_file.is_open()) throw std::runtime_error("");
+    // save the counts of the outer classes (PSF larger than 3x3)
+    if (!energy_outer.empty()) {
+        std::fstream outer_file(outer_counts_path, std::ios::out);
+        if (!outer_file.is_open()) throw std::runtime_error("");
 
-    and_file << "Bin 0, Bin T,Counts\n";
-    for (int i = 0; i < counts_and[0].size(); i++) {
-        for (int j = 0; j < counts_and[0][i].size(); j++)
-            and_file << i << "," << j << "," << counts_and[0][i][j] << "\n";
+        outer_file << "Class,Bin,Counts\n";
+        for (int k = 0; k < energy_outer.size(); k++) {
+            for (int i = 0; i < energy_outer[k].size(); i++)
+                outer_file << k + MAX_PSF_ELEMENTS - 1 << "," << i << "," << energy_outer[k][i] << "\n";
+        }
+    }
+
+    // save and (a sparse matrix is saved without the empty bins)
+    constexpr std::array<const char *, MAX_PSF_ELEMENTS - 1> and_headers = {"Bin 0, Bin T,Counts\n",
+                                                                            "Bin 0, Bin TR,Counts\n"};
+    const std::array<std::filesystem::path, MAX_PSF_ELEMENTS - 1> and_paths = {and_path, and_tr_path};
+    for (int k = 0; k < counts_and.size(); k++) {
+        and_file.open(and_paths[k], std::ios::out);
+        if (!and_file.is_open()) throw std::runtime_error("");
+
+        and_file << and_headers[k];
+        if (counts_and[k].is_dense()) {
+            for (int i = 0; i < counts_and[k].size(); i++) {
+                for (int j = 0; j < counts_and[k].size(); j++)
+                    and_file << i << "," << j << "," << counts_and[k](i, j) << "\n";
+            }
+        } else {
+            counts_and[k].for_each_nonzero(
+                [&](int i, int j, std::uint64_t counts) { and_file << i << "," << j << "," << counts << "\n"; });
+        }
+        and_file.close();
     }
 
-    // save probabilities
-    probabilities_file.open(probabilities_path, std::ios::out);
+    // save the three-pixel coincidences (only the bins with counts)
+    and_file.open(and_t_tr_path, std::ios::out);
     if (!and_file.is_open()) throw std::runtime_error("");
 
-    probabilities_file << "Bin i, Bin j, Probability\n";
-    for (int i = 0; i < counts_and[0].size(); i++) {
-        for (int j = 0; j < counts_and[0][i].size(); j++) {
-            probabilities_file << i << "," << j << "," << transition_probabilities[i][j] << "\n";
-        }
+    and_file << "Bin 0,Bin T,Bin TR,Counts\n";
+    counts_and_t_tr.for_each_nonzero([&](int i, int j, int k, std::uint64_t counts) {
+        and_file << i << "," << j << "," << k << "," << counts << "\n";
+    });
+    and_file.close();
+
+    // save probabilities (only the nonzero ones)
+    if (save_probabilities) {
+        probabilities_file.open(probabilities_path, std::ios::out);
+        if (!probabilities_file.is_open()) throw std::runtime_error("");
+
+        probabilities_file << "Bin i, Bin j, Probability\n";
+        for (const auto &cell : transition_probabilities.cells)
+            probabilities_file << cell.i << "," << cell.j << "," << cell.probability << "\n";
+        probabilities_file.close();
     }
 
     // close files
     counts_file.close();
-    and_file.close();
-    probabilities_file.close();
+}
+
+/**
+ * Function for writing the measured and the reconstructed
+ * spectrum of the pixel 0 as rows of a sweep table.
+ *
+ * @param[in] file The stream where to write the rows.
+ * @param[in] config The index of the binning in the sweep.
+ */
+void pixel::PixelCollection::save_spectrum(std::ostream &file, int config) const
+{
+    for (int i = 0; i < energy_measured[0].size(); i++) {
+        file << config << "," << binning.n_thresholds << "," << binning.min_threshold << "," << binning.max_threshold
+             << "," << i << "," << energy_measured[0][i] << "," << energy_corrected[0][i] << "\n";
+    }
 }
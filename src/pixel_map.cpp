@@ -0,0 +1,312 @@
+#include "pixel_map.hh"
+
+#include "constants.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+
+bool pixel::PixelMap::verbose = false;
+
+/**
+ * The default constructor.
+ *
+ * @param[in] psf The pointer to the structure containing the info about
+ * the point spread function to consider.
+ * @param[in] binning The energy binning of the counts.
+ */
+pixel::PixelMap::PixelMap(std::shared_ptr<data::PSFInfo> psf, const Binning &binning)
+    : binning(binning)
+    , psf_info(psf)
+{
+    std::size_t n_cells = psf_info->pixels.size() * binning.n_thresholds;
+
+    energy_measured = CounterArray<std::uint16_t>(n_cells);
+    counts_and = CoincidenceTensor(binning.n_thresholds);
+    event_bins.assign(psf_info->pixels.size(), -1);
+}
+
+/**
+ * Function for storing the hits of
+ * the current event (the ones outside
+ * the binning are not used).
+ *
+ * The bins are the ones already computed by the pixel
+ * collection with the same binning, so the energies
+ * of the event are not binned again.
+ *
+ * @param[in] ids The IDs of the pixels hit.
+ * @param[in] bins The energy bins of the hits, in [-1, N].
+ */
+void pixel::PixelMap::fill_hits(data::Span<Int_t> ids, data::Span<int> bins)
+{
+    for (std::size_t i = 0; i < ids.size(); i++) {
+        int id = ids[i];
+        int bin = bins[i];
+        if (bin == BinIndexer::UNDERFLOW_BIN || bin == binning.n_thresholds) continue;
+
+        if (event_bins[id] < 0) event_hits.push_back(id);
+        event_bins[id] = bin;
+    }
+}
+
+/**
+ * Function for adding the hits of the
+ * current event to the counts and the
+ * coincidences of each pixel hit with
+ * the T pixels hit around it.
+ */
+void pixel::PixelMap::end_event()
+{
+    const int N = binning.n_thresholds;
+    const data::PSFInfo &psf = *psf_info;
+
+    for (int id : event_hits) {
+        int bin = event_bins[id];
+        energy_measured.increment(id * N + bin);
+
+        for (int k = 0; k < PSF_NEIGHBOURS; k++) {
+            int neighbour = psf.neighbours[id][k];
+            if (neighbour >= 0 && event_bins[neighbour] >= 0) counts_and.increment(id, bin, event_bins[neighbour]);
+        }
+    }
+
+    // the bins are reset only after all the coincidences are counted
+    for (int id : event_hits)
+        event_bins[id] = -1;
+
+    if (verbose) printf("%sDEBUG - Pixel map: %zu pixels hit.%s\n", DEBUG_COLOR, event_hits.size(), END_COLOR);
+    event_hits.clear();
+}
+
+/**
+ * Function for adding the counts of another
+ * pixel map to this one.
+ *
+ * @param[in] other The pixel map to add, with the same binning.
+ */
+void pixel::PixelMap::merge(const PixelMap &other)
+{
+    energy_measured.add(other.energy_measured);
+    counts_and.add(other.counts_and);
+}
+
+/**
+ * Function for resetting the counts.
+ */
+void pixel::PixelMap::reset()
+{
+    energy_measured.reset();
+    counts_and.reset();
+    energy_corrected.clear();
+    transition_probabilities.clear();
+}
+
+/**
+ * Function for computing the corrected counts and the
+ * transition probabilities of each pixel from its own
+ * 0-T coincidences, as done for pixel 0 by the pixel
+ * collection (the pixels without coincidences keep
+ * their measured counts).
+ *
+ * The pixels are split into contiguous ranges, one for each thread.
+ *
+ * @param[in] n_threads The number of threads to use.
+ */
+void pixel::PixelMap::compute_transition_probabilities(int n_threads)
+{
+    const int N = binning.n_thresholds;
+    const int sum_offset = binning.get_sum_offset();
+    int n_pixels = psf_info->pixels.size();
+
+    // coincidences grouped by pixel, in row-major order
+    struct Coincidence
+    {
+        int i;
+        int j;
+        std::uint64_t counts;
+    };
+    std::vector<Coincidence> coincidences;
+    std::vector<std::size_t> pixel_start(n_pixels + 1, 0);
+    coincidences.reserve(counts_and.get_n_entries());
+    counts_and.for_each_nonzero([&](int id, int i, int j, std::uint64_t counts) {
+        coincidences.push_back({i, j, counts});
+        pixel_start[id + 1]++;
+    });
+    for (int id = 0; id < n_pixels; id++)
+        pixel_start[id + 1] += pixel_start[id];
+
+    energy_corrected.assign(energy_measured.size(), 0.0);
+    transition_probabilities.assign(n_pixels, {N, {}});
+
+    auto compute_range = [&](int first, int last) {
+        std::vector<long long> anti_diagonal_sums(N), column_sums(N);
+        std::vector<long long> row_0(N), column_0(N); // coincidences with the pixel (T) in the bin 0
+
+        for (int id = first; id < last; id++) {
+            std::fill(anti_diagonal_sums.begin(), anti_diagonal_sums.end(), 0);
+            std::fill(column_sums.begin(), column_sums.end(), 0);
+            std::fill(row_0.begin(), row_0.end(), 0);
+            std::fill(column_0.begin(), column_0.end(), 0);
+
+            for (std::size_t c = pixel_start[id]; c < pixel_start[id + 1]; c++) {
+                const Coincidence &coincidence = coincidences[c];
+                if (coincidence.i == 0) row_0[coincidence.j] = coincidence.counts;
+                if (coincidence.j == 0) column_0[coincidence.i] = coincidence.counts;
+
+                int sum = coincidence.i + coincidence.j + sum_offset;
+                if (sum >= 0 && sum < N) {
+                    anti_diagonal_sums[sum] += coincidence.counts;
+                    column_sums[coincidence.j] += coincidence.counts;
+                }
+            }
+
+            // get corrected counts
+            double *corrected = &energy_corrected[std::size_t(id) * N];
+            for (int i = 0; i < N; i++) {
+                int j_0 = i - sum_offset; // bin of T on the anti-diagonal i when the pixel is in the bin 0
+                long long measured = energy_measured[std::size_t(id) * N + i];
+                long long correction_1 = column_sums[i] - ((i + sum_offset < N) ? row_0[i] : 0);
+                long long correction_2 = anti_diagonal_sums[i] - ((j_0 >= 0 && j_0 < N) ? row_0[j_0] : 0);
+
+                corrected[i] = std::llround(measured - correction_1 + correction_2 - 0.5 * column_0[i]);
+            }
+
+            // get transition probabilities (0 if the sum of the energies falls outside the binning)
+            std::vector<solve_system::TransitionProbabilities::Cell> &cells = transition_probabilities[id].cells;
+            for (std::size_t c = pixel_start[id]; c < pixel_start[id + 1]; c++) {
+                const Coincidence &coincidence = coincidences[c];
+                int sum = coincidence.i + coincidence.j + sum_offset;
+                if (sum < 0 || sum >= N) continue;
+
+                double probability = static_cast<double>(coincidence.counts) / corrected[sum];
+                if (std::isnan(probability) || probability <= 0) continue;
+                cells.push_back({coincidence.i, coincidence.j, std::min(probability, 2.0)});
+            }
+        }
+    };
+
+    n_threads = std::clamp(n_threads, 1, std::max(n_pixels, 1));
+    int pixels_per_thread = (n_pixels + n_threads - 1) / n_threads;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; t++) {
+        int first = std::min(n_pixels, t * pixels_per_thread);
+        int last = std::min(n_pixels, (t + 1) * pixels_per_thread);
+        if (first < last) threads.emplace_back(compute_range, first, last);
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    printf("%sINFO - Computed the transition probabilities of %i pixels from %zu coincidence bins with %zu "
+           "thread(s).%s\n",
+           INFO_COLOR, n_pixels, coincidences.size(), threads.size(), END_COLOR);
+}
+
+/**
+ * Function for reconstructing the spectra of all the pixels
+ * with the same transition probabilities (e.g. the ones of
+ * a calibration).
+ *
+ * The pixels are split into contiguous ranges, one
+ * for each thread, and each range is solved as a batch.
+ *
+ * @param[in] solver The solver built from the transition probabilities.
+ * @param[in] n_threads The number of threads to use.
+ */
+void pixel::PixelMap::reconstruct_spectra(const solve_system::Solver &solver, int n_threads)
+{
+    const int N = binning.n_thresholds;
+    if (solver.get_n_bins() != N) {
+        printf("%sERROR - The transition probabilities have %i bins instead of %i%s\n", ERROR_COLOR,
+               solver.get_n_bins(), N, END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    int n_pixels = psf_info->pixels.size();
+    energy_corrected.assign(energy_measured.size(), 0.0);
+
+    // ranges of whole solver blocks
+    int n_blocks = (n_pixels + solve_system::SOLVE_BLOCK_SIZE - 1) / solve_system::SOLVE_BLOCK_SIZE;
+    n_threads = std::clamp(n_threads, 1, std::max(n_blocks, 1));
+    int blocks_per_thread = (n_blocks + n_threads - 1) / n_threads;
+
+    auto solve_range = [&](int first, int last) {
+        std::vector<double> counts(std::size_t(last - first) * N);
+        energy_measured.copy(std::size_t(first) * N, std::size_t(last) * N, counts.data());
+        solver.solve_batch(counts.data(), &energy_corrected[std::size_t(first) * N], last - first);
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < n_threads; t++) {
+        int first = std::min(n_pixels, t * blocks_per_thread * solve_system::SOLVE_BLOCK_SIZE);
+        int last = std::min(n_pixels, (t + 1) * blocks_per_thread * solve_system::SOLVE_BLOCK_SIZE);
+        if (first < last) threads.emplace_back(solve_range, first, last);
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    printf("%sINFO - Reconstructed the spectra of %i pixels with %zu thread(s).%s\n", INFO_COLOR, n_pixels,
+           threads.size(), END_COLOR);
+}
+
+/**
+ * Function for saving the spectra of the
+ * pixels to a .csv file (the pixels
+ * without counts are not written).
+ *
+ * @param[in] path The path of the .csv file.
+ */
+void pixel::PixelMap::save_output(const std::string &path) const
+{
+    const int N = binning.n_thresholds;
+
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    file << "Pixel,X,Y,Bin,Counts,Corrected counts\n";
+    for (int id = 0; id < psf_info->pixels.size(); id++) {
+        bool empty = true;
+        for (int bin = 0; bin < N && empty; bin++)
+            empty = !energy_measured[std::size_t(id) * N + bin];
+        if (empty) continue;
+
+        const data::PixelInfo &pixel = psf_info->pixels[id];
+        for (int bin = 0; bin < N; bin++) {
+            std::size_t cell = std::size_t(id) * N + bin;
+            file << id << "," << pixel.x << "," << pixel.y << "," << bin << "," << energy_measured[cell] << ","
+                 << ((energy_corrected.empty()) ? 0.0 : energy_corrected[cell]) << "\n";
+        }
+    }
+
+    printf("%sINFO - Saved the spectra of the pixels to %s.%s\n", INFO_COLOR, path.c_str(), END_COLOR);
+}
+
+/**
+ * Function for saving the transition probabilities
+ * of the pixels to a .csv file (only the ones
+ * different from 0 are written).
+ *
+ * @param[in] path The path of the .csv file.
+ */
+void pixel::PixelMap::save_transition_probabilities(const std::string &path) const
+{
+    std::ofstream file(path);
+    if (!file.is_open()) {
+        printf("%sERROR - Impossible to open %s%s\n", ERROR_COLOR, path.c_str(), END_COLOR);
+        throw std::runtime_error("");
+    }
+
+    file << "Pixel,Bin i,Bin j,Probability\n";
+    for (int id = 0; id < transition_probabilities.size(); id++)
+        for (const solve_system::TransitionProbabilities::Cell &cell : transition_probabilities[id].cells)
+            file << id << "," << cell.i << "," << cell.j << "," << cell.probability << "\n";
+
+    printf("%sINFO - Saved the transition probabilities of the pixels to %s.%s\n", INFO_COLOR, path.c_str(),
+           END_COLOR);
+}